@@ -3,24 +3,25 @@
 #include <BLE2902.h>
 #include <M5Core2.h>
 #include <Adafruit_seesaw.h>
+#include <game_engine.h>
+#include <peer_link.h>
 #include <Arduino.h>
 
+// Symmetric peer mode (lib/PeerLink): one connection between the two devices,
+// elected at discovery, instead of each being a server and a client of the
+// other. Must match the other device.
+#define PEER_MODE 0
+
 // State
 enum Screen { S_GAME, S_GAME_OVER };
 static Screen screen = S_GAME;
 
 // method header definitions
-void drawDots(uint32_t xJoyIn, uint32_t yJoyIn); // , uint32_t xButIn, uint32_t yButIn);
-void joyAccelIncrement();
-void warpDot();
-String milis_to_seconds(long milis);
-void playGame();
-void endGame();
-bool checkDistance();
 unsigned long lastTime = 0;
 
 // Initialize Variables
 Adafruit_seesaw gamePad;
+StatusScreen status;
 
 // #define BUTTON_X         6
 // #define BUTTON_Y         2
@@ -39,6 +40,25 @@ int xJoy = 10, yJoy = 120, xRemote = 0, yRemote = 0;
 // joystick and button acceleration
 int joyAccel = 1; // , butAccel = 1;
 
+// The peer link (PEER_MODE), whether it was up last loop(), and the peer's dot from it
+PeerLink peer;
+bool peerLinked = false;
+void peerMoved(int x, int y) {
+    xRemote = x;
+    yRemote = y;
+}
+
+// The shared game: our dot on the joystick, the peer's from its notifications.
+// In PEER_MODE our moves go out over the peer link.
+struct PeerGame : NetworkRole {
+    static void moved(int x, int y) {
+        if (PEER_MODE)
+            peer.send(x, y);
+    }
+    static void warped(int x, int y) { moved(x, y); }
+};
+GameEngine<PeerGame> game(gamePad, xJoy, yJoy, joyAccel, xRemote, yRemote);
+
 ///////////////////////////////////////////////////////////////
 // Server Variables
 ///////////////////////////////////////////////////////////////
@@ -248,39 +268,44 @@ void setup() {
     // Initialize M5Core2 as a BLE server
     Serial.print("Starting BLE...");
     String bleDeviceName = "First M5Core2";
-    BLEDevice::init(bleDeviceName.c_str());
+    if (PEER_MODE) {
+        peer.begin(bleDeviceName.c_str(), peerMoved);
+        drawScreenTextWithBackground("Looking for the other peer as:\n\n" + bleDeviceName, TFT_BLUE);
+    } else {
+        BLEDevice::init(bleDeviceName.c_str());
 
-    //Service Init
+        //Service Init
     
-    // Retrieve a Scanner and set the callback we want to use to be informed when we
-    // have detected a new device.  Specify that we want active scanning and start the
-    // scan to run for 5 seconds.
-    BLEScan *pBLEScan = BLEDevice::getScan();
-    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-    pBLEScan->setInterval(1349);
-    pBLEScan->setWindow(449);
-    pBLEScan->setActiveScan(true);
-    pBLEScan->start(0, false);
-
-    if (doConnect == true)
-    {
-        if (connectToServer()) {
-            Serial.println("We are now connected to the BLE Server.");
-            drawScreenTextWithBackground("Connected to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
-            doConnect = false;
-            delay(3000);
-        }
-        else {
-            Serial.println("We have failed to connect to the server; there is nothin more we will do.");
-            drawScreenTextWithBackground("FAILED to connect to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
-            delay(3000);
+        // Retrieve a Scanner and set the callback we want to use to be informed when we
+        // have detected a new device.  Specify that we want active scanning and start the
+        // scan to run for 5 seconds.
+        BLEScan *pBLEScan = BLEDevice::getScan();
+        pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
+        pBLEScan->setInterval(1349);
+        pBLEScan->setWindow(449);
+        pBLEScan->setActiveScan(true);
+        pBLEScan->start(0, false);
+
+        if (doConnect == true)
+        {
+            if (connectToServer()) {
+                Serial.println("We are now connected to the BLE Server.");
+                drawScreenTextWithBackground("Connected to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
+                doConnect = false;
+                delay(3000);
+            }
+            else {
+                Serial.println("We have failed to connect to the server; there is nothin more we will do.");
+                drawScreenTextWithBackground("FAILED to connect to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
+                delay(3000);
+            }
         }
-    }
 
-    // Broadcast the BLE server
-    drawScreenTextWithBackground("Initializing BLE...", TFT_CYAN);
-    broadcastBleServer();
-    drawScreenTextWithBackground("Broadcasting as BLE server named:\n\n" + bleDeviceName, TFT_BLUE);
+        // Broadcast the BLE server
+        drawScreenTextWithBackground("Initializing BLE...", TFT_CYAN);
+        broadcastBleServer();
+        drawScreenTextWithBackground("Broadcasting as BLE server named:\n\n" + bleDeviceName, TFT_BLUE);
+    }
     
     // Sets up Gamepad QT
 
@@ -290,44 +315,58 @@ void setup() {
     }
     gamePad.pinModeBulk(button_mask, INPUT_PULLUP);
     gamePad.setGPIOInterrupts(button_mask, 1);
+    game.calibrate();
 }
 
 ///////////////////////////////////////////////////////////////
 // Put your main code here, to run repeatedly
 ///////////////////////////////////////////////////////////////
 void loop() {
-    if (remoteDeviceConnected) {
+    if (PEER_MODE) {
+        peer.update();
+        // The peer only learns where our dot is from its moves; start it off
+        if (peer.connected() && !peerLinked) {
+            peer.send(xJoy, yJoy);
+            previouslyConnected = true;
+        }
+        peerLinked = peer.connected();
+    }
+
+    if (PEER_MODE ? peerLinked : remoteDeviceConnected) {
 
         // Ping pong code
-        bool stillPlaying = checkDistance();
+        bool stillPlaying = game.checkDistance();
 
         if (screen == S_GAME && stillPlaying) {
-            playGame();
+            game.play();
         } else {
             if (lastTime == 0) {
             lastTime = millis();
             }
-            endGame();
+            game.endGame(lastTime);
             delay(50000);
         }
 
 
     } else if (previouslyConnected) {
-        drawScreenTextWithBackground("Disconnected. Reset M5 device to reinitialize BLE.", TFT_RED); // Give feedback on screen
+        if (PEER_MODE)
+            drawScreenTextWithBackground("Disconnected. Looking for the other peer...", TFT_RED);
+        else
+            drawScreenTextWithBackground("Disconnected. Reset M5 device to reinitialize BLE.", TFT_RED); // Give feedback on screen
         timer = 0;
     }
     
-    // Only update the timer (if connected) every 1 second
-    delay(1000);
+    // Only update the timer (if connected) every 1 second; the peer link plays at full rate
+    if (!PEER_MODE)
+        delay(1000);
 }
 
 ///////////////////////////////////////////////////////////////
-// Colors the background and then writes the text on top
+// Colors the background and then writes the text on top (only
+// what changed since the last call, see StatusScreen)
 ///////////////////////////////////////////////////////////////
 void drawScreenTextWithBackground(String text, int backgroundColor) {
-    M5.Lcd.fillScreen(backgroundColor);
-    M5.Lcd.setCursor(0,0);
-    M5.Lcd.println(text);
+    status.show(text, backgroundColor);
 }
 
 ///////////////////////////////////////////////////////////////
@@ -368,106 +407,3 @@ void broadcastBleServer() {
     Serial.println("Characteristic defined...you can connect with your phone!"); 
 
 }
-
-
-/////////////////////////////
-// dots
-////////////////////////////
-bool checkDistance() {
-  long distance = abs(sqrt(pow((xRemote - xJoy), 2) + pow((yRemote - yJoy), 2)));
-  if (distance <= 30) {
-    return false;
-  }
-  return true;
-}
-
-void drawDots(uint32_t xJoyIn, uint32_t yJoyIn) {
-    M5.Lcd.drawPixel(xJoyIn, yJoyIn, TFT_RED);
-    M5.Lcd.drawPixel(xRemote, yRemote, TFT_BLUE);
-}
-
-void joyAccelIncrement() {
-  if (joyAccel == 5) {
-    joyAccel = 1;
-  } else {
-    joyAccel++;
-  }
-}
-
-void warpDot() {
-  // create random ints for x and y and have the dot drawn there next
-  int randx = rand() % M5.Lcd.width();
-  int randy = rand() % M5.Lcd.height();
-  xJoy = randx;
-  yJoy = randy;
-}
-
-String milis_to_seconds(long milis) {
-    unsigned long seconds = milis / 1000;
-    String secondStr = seconds < 10 ? "0" + String(seconds) : String(seconds);
-    unsigned long miliseconds = milis % 60;
-    String milisecondsStr = miliseconds < 10 ? "0" + String(miliseconds) : String(miliseconds);
-    return secondStr + "." + milisecondsStr + "s";
-}
-
-void endGame() {
-  M5.Lcd.fillScreen(TFT_MAGENTA);
-  M5.Lcd.setTextColor(TFT_BLACK);
-  M5.Lcd.setTextSize(3);
-  M5.Lcd.drawString("GAME OVER", M5.Lcd.width() / 4, M5.Lcd.height() / 2 - 30);
-  M5.Lcd.setTextSize(2);
-  M5.Lcd.drawString("YOU LASTED FOR", M5.Lcd.width() / 4, M5.Lcd.height() / 2);
-  M5.Lcd.drawString(milis_to_seconds(lastTime), M5.Lcd.width() / 4, M5.Lcd.height() - 100);
-}
-
-void playGame() {
-  M5.Lcd.fillScreen(TFT_BLACK);
-  // Reverse x/y values to match joystick orientation
-  int x = 1023 - gamePad.analogRead(14);
-  int y = 1023 - gamePad.analogRead(15);
-
-  // Left & Right For Joystick
-  if (x > 600) {
-    for (int i = 0; i < joyAccel; i++) {
-      if ((xJoy + 1) < 320) {
-        xJoy++;
-      }
-    }
-  } else if (x < 500) {
-    for (int i = 0; i < joyAccel; i++) {
-      if ((xJoy - 1) > 0) {
-        xJoy--;
-      }
-    }
-  }
-
-  if (y < 480) {
-    for (int i = 0; i < joyAccel; i++) {
-      if ((yJoy + 1) < 240) {
-        yJoy++;
-      }
-    }
-  } else if (y > 560) {
-    for (int i = 0; i < joyAccel; i++) {
-      if ((yJoy - 1) > 0) {
-        yJoy--;
-      }
-    }
-  }
-
-  // For the gamepad buttons - select and start
-  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
-
-  if (! (buttons & (1UL << BUTTON_SELECT))) {
-    joyAccelIncrement();
-    Serial.print("Joy Accel: "); Serial.print(joyAccel);
-    delay(500);
-  }
-  if (! (buttons & (1UL << BUTTON_START))) {
-    warpDot();
-    Serial.print("Dot Warped to : "); Serial.print(x + ", " + y);
-    delay(500);
-  }
-
-  drawDots(xJoy, yJoy);
-}
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include <BLE2902.h>
 #include <M5Core2.h>
 #include <Adafruit_seesaw.h>
+#include <LittleFS.h>
+#include <lockstep.h>
+#include <latency.h>
+#include <match_recorder.h>
+#include <telemetry.h>
+#include <game_engine.h>
+#include "game_protocol.h"
 
 ///////////////////////////////////////////////////////////////
 // Variables
@@ -16,12 +23,24 @@ BLECharacteristic *bleReadXCharacteristic;
 BLECharacteristic *bleReadYCharacteristic;
 BLECharacteristic *bleReadWriteXCharacteristic;
 BLECharacteristic *bleReadWriteYCharacteristic;
+BLECharacteristic *bleStateCharacteristic;
+BLECharacteristic *bleControlCharacteristic;
+BLECharacteristic *bleLockstepCharacteristic;
+BLECharacteristic *bleInputCharacteristic;
+BLECharacteristic *bleClockCharacteristic;
+BLECharacteristic *bleLatencyCharacteristic;
+BLECharacteristic *bleLinkStatsCharacteristic;
 bool deviceConnected = false;
 bool previouslyConnected = false;
+bool disconnectShown = false;       // the disconnect screen replaced whatever was drawn
 int timer = 0;
 unsigned long lastTime = 0;
 unsigned long timerDelay = 500;
 bool locationWasUpdated = true;
+String bleDeviceName = "Duct Tape n' Prayer";
+
+// Boot: BLE comes up in its own task while the main task does the LCD and gamepad
+static SemaphoreHandle_t bleReady;
 
 // Unique IDs
 #define SERVICE_UUID "7d7a7768-a9d0-4fb8-bf2b-fc994c662eb6"
@@ -29,6 +48,78 @@ bool locationWasUpdated = true;
 #define READ_Y_CHARACTERISTIC_UUID "aa88ac15-3e2b-4735-92ff-4c712173e9f3"
 #define READ_WRITE_X_CHARACTERISTIC_UUID "1da468d6-993d-4387-9e71-1c826b10fff9"
 #define READ_WRITE_Y_CHARACTERISTIC_UUID "cf7b4787-d412-4e69-8b61-e2cfba89ff19"
+#define STATE_CHARACTERISTIC_UUID "0b8e2f5a-6c1d-4e3b-9a47-5d2c8f1e6a90"
+#define CONTROL_CHARACTERISTIC_UUID "e4c1a7d2-58b3-4f0e-8d96-2a7b3c9e1f45"
+#define LOCKSTEP_CHARACTERISTIC_UUID "7f3d9c2e-1b4a-4e6f-a8d5-3c9b2e7f1a64"
+#define INPUT_CHARACTERISTIC_UUID "3a6e9b1d-7c4f-4a2e-b8d3-6f1e2c9a5b07"
+#define CLOCK_CHARACTERISTIC_UUID "5e2b8c41-9d7a-4f36-b1e8-0c4a7d3f962b"
+#define LATENCY_CHARACTERISTIC_UUID "c9a4e1f7-2d6b-4c8e-9f31-7b5a0d2e8c16"
+#define LINK_STATS_CHARACTERISTIC_UUID "2f6c8d13-a4b7-4e59-b0c2-9d1e7a3f5c48"
+
+// Attribute handles for the service: 1 + 2 per characteristic + 1 per CCCD
+// (the library's default of 15 is too few for all of the above)
+#define SERVICE_HANDLES 32
+
+// Lockstep mode: instead of publishing positions, both devices exchange only their
+// per-tick inputs and run the same simulation (lib/GameCore). Must match the client.
+#define LOCKSTEP_MODE 0
+
+// Authoritative mode: the client only forwards its inputs and this device runs
+// the one simulation, collision included. Must match the client.
+#define AUTHORITATIVE_MODE 0
+
+// Match recording: inputs, positions and BLE events go to /serverNNN.rec on
+// LittleFS, or on the SD card when RECORD_TO_SD is set
+#define MATCH_RECORDING 0
+#define RECORD_TO_SD 0
+
+// Latency measurement: every move is stamped with the time its joystick sample
+// was taken and the receiver times the frame that draws it, so both directions
+// of input-to-photon latency end up in histograms (printed every
+// LATENCY_REPORT_MS). Must match the client.
+#define LATENCY_MODE 0
+#define LATENCY_REPORT_MS 10000
+
+// Task layout (lib/GameEngine/src/task_layout.h): BLE on core 0, loop() on
+// core 1. With RENDER_TASK, frames are drawn by a task of their own on core 1,
+// above loop() (which never blocks) and idle until a frame arrives; RENDER_DMA
+// has it push them in DMA strips and sleep through the transfers.
+// CORE_LOAD_REPORT logs both cores' load, and RENDER_REPORT the frame rates,
+// every CORE_LOAD_REPORT_MS.
+#define GAME_TASK_PRIORITY 1
+#define RENDER_TASK 0
+#define RENDER_TASK_PRIORITY 2
+#define RENDER_DMA 0
+#define CORE_LOAD_REPORT 0
+#define RENDER_REPORT 0
+#define CORE_LOAD_REPORT_MS 5000
+
+// Telemetry (lib/Telemetry): a binary stream of per-frame stage timings and
+// per-second RTT and memory stats on the USB serial port, for tools/telemetry
+// to turn into CSV or a live dashboard. Text logging carries on alongside (the
+// decoder shows it as log lines), except the per-event lines of the
+// characteristic callbacks (EVENT_LOG), which would crowd the frames out of the
+// UART; TELEMETRY_BAUD can raise the port's rate.
+#define TELEMETRY 0
+#define TELEMETRY_BAUD 115200
+#define TELEMETRY_STATS_MS 1000
+#define EVENT_LOG (!TELEMETRY)
+
+#if LOCKSTEP_MODE && AUTHORITATIVE_MODE
+#error "Pick one of LOCKSTEP_MODE and AUTHORITATIVE_MODE"
+#endif
+#if LATENCY_MODE && (LOCKSTEP_MODE || AUTHORITATIVE_MODE)
+#error "LATENCY_MODE measures the default (position) mode"
+#endif
+#if LATENCY_MODE && RENDER_TASK
+#error "LATENCY_MODE times frames drawn inside loop(), not on the render task"
+#endif
+#if RENDER_DMA && !RENDER_TASK
+#error "RENDER_DMA needs RENDER_TASK"
+#endif
+#if RENDER_DMA && MATCH_RECORDING && RECORD_TO_SD
+#error "The SD card shares the LCD's SPI bus, which RENDER_DMA holds for a whole frame"
+#endif
 
 // State
 enum Screen { S_GAME, S_GAME_OVER };
@@ -36,35 +127,170 @@ static Screen screen = S_GAME;
 
 // Gameplay Variables
 Adafruit_seesaw gamePad;
+StatusScreen status;
 
 #define BUTTON_SELECT    0
 #define BUTTON_START    16
 uint32_t button_mask = (1UL << BUTTON_START) | (1UL << BUTTON_SELECT);
 
-// joystick and button coordinates
-int xServer = 10, yServer = 120, xClient = 0, yClient = 0;
+// joystick and button coordinates (client starts where the client sketch puts it)
+#define SERVER_START_X 10
+#define SERVER_START_Y 120
+#define CLIENT_START_X 300
+#define CLIENT_START_Y 120
+int xServer = SERVER_START_X, yServer = SERVER_START_Y, xClient = CLIENT_START_X, yClient = CLIENT_START_Y;
 // joystick and button acceleration
 int acceleration = 1;
 
+// Match session: survives disconnects so a reconnecting client can resume
+uint32_t matchSessionId = 0;
+unsigned long matchStartTime = 0;
+unsigned long disconnectTime = 0;
+volatile bool rematchRequested = false;
+bool rematchStartHeld = false;      // START was down when the game ended (see pollRematch)
+
+// Lockstep simulation and the client inputs received on the BLE task
+LockstepSession lockstep(true);
+QueueHandle_t lockstepInbox;
+unsigned long lastTickTime = 0;
+volatile bool lockstepResync = false;
+
+// Authoritative simulation and the client input samples waiting for their tick
+GameState authority;
+QueueHandle_t inputInbox;
+uint8_t clientInputs[16];
+uint8_t clientInputHead = 0;
+uint8_t clientInputCount = 0;
+uint8_t clientInput = 0;
+uint16_t lastInputSeq = 0;
+volatile bool inputResync = false;
+
+// Latency measurement: our moves' stamps go out with the positions (the client
+// keeps that direction's histogram); the client's newest stamp waits here until
+// loop() hands it to clientMoves, which knows when each of its positions was
+// first drawn. Our micros() is the shared timebase.
+LatencyHistogram clientToServer;
+LatencyMatcher clientMoves;
+LatencyStamp clientStamp;
+volatile bool clientStampPending = false;
+portMUX_TYPE clientStampMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t moveSampleUs = 0;
+uint16_t latencySeq = 0;
+unsigned long lastLatencyReport = 0;
+
+// Link statistics: counted on the BLE task (linkStatsGattsHandler() and the
+// characteristic callbacks) and published from loop() once a second
+#define LINK_STATS_INTERVAL_MS 1000
+volatile uint32_t notifiesSent = 0;
+volatile uint32_t writesReceived = 0;
+volatile uint32_t bytesSent = 0;
+volatile uint32_t bytesReceived = 0;
+volatile uint16_t statusErrors[LINK_STATUS_ERRORS];
+uint32_t loopCount = 0;
+unsigned long lastLinkStats = 0;
+uint32_t publishedBytesSent = 0;
+uint32_t publishedBytesReceived = 0;
+uint32_t publishedLoopCount = 0;
+
+// Per-core load (a no-op unless CORE_LOAD_REPORT)
+CoreLoad coreLoad;
+
+// Recorder (a no-op unless MATCH_RECORDING) and the last position it logged
+MatchRecorder recorder;
+int recordedPosition[4] = { -1, -1, -1, -1 };
+
+// Telemetry stream (a no-op unless TELEMETRY)
+Telemetry telemetry;
+
+void publishSnapshot(bool notify);
+void recordPosition();
+
+// The shared game, with our dot (server) on the joystick; moves are notified from loop()
+struct ServerGame : ServerRole {
+    static void moved(int x, int y) {
+        locationWasUpdated = true;
+        moveSampleUs = micros();    // the stick was read just before the move
+    }
+    static void warped(int x, int y) {
+        bleReadXCharacteristic->setValue(x);
+        bleReadYCharacteristic->setValue(y);
+
+        bleReadXCharacteristic->notify();
+        delay(10);
+        bleReadYCharacteristic->notify();
+        delay(10);
+    }
+    static void sampled(uint8_t input) {
+        recorder.input(SIDE_LOCAL, input);
+    }
+};
+GameEngine<ServerGame> game(gamePad, xServer, yServer, acceleration, xClient, yClient);
+
 ///////////////////////////////////////////////////////////////
 // BLE Server Callback Methods
 ///////////////////////////////////////////////////////////////
 class MyServerCallbacks: public BLEServerCallbacks {
     void onConnect(BLEServer *pServer) {
+        // Current location is readable right away; it is pushed once the client subscribes
         deviceConnected = true;
         bleReadXCharacteristic->setValue(xServer);
         bleReadYCharacteristic->setValue(yServer);
-        
-        bleReadXCharacteristic->notify();
-        delay(10);
-        bleReadYCharacteristic->notify();
-        delay(10);
+
+        // Start the match on the first connection; on a reconnect, don't count the time we were apart
+        if (!previouslyConnected)
+            matchStartTime = millis();
+        else
+            matchStartTime += millis() - disconnectTime;
+        publishSnapshot(false);
+        lockstepResync = true;
+        inputResync = true;
         previouslyConnected = true;
+        recorder.ble(BLE_CONNECTED);
         Serial.println("Device connected...");
     }
     void onDisconnect(BLEServer *pServer) {
         deviceConnected = false;
+        disconnectTime = millis();
+        recorder.ble(BLE_DISCONNECTED);
         Serial.println("Device disconnected...");
+
+        // Keep the match and advertise again straight away so the client can come back
+        pServer->startAdvertising();
+    }
+};
+
+//////////////////////////////////////////////////////////////
+// One characteristic event on the serial port (EVENT_LOG): the
+// value as text when it is text (the X/Y position writes),
+// otherwise as hex bytes (the binary packets and notifies)
+//////////////////////////////////////////////////////////////
+static void logEvent(const char *what, const String &characteristicUUID, const std::string &value) {
+    Serial.printf("%s %s:", what, characteristicUUID.c_str());
+    bool text = !value.empty();
+    for (char c : value)
+        text = text && isprint((unsigned char)c);
+    if (text) {
+        Serial.printf(" %s\n", value.c_str());
+        return;
+    }
+    for (char c : value)
+        Serial.printf(" %02x", (uint8_t)c);
+    Serial.println();
+}
+
+//////////////////////////////////////////////////////////////
+// CCCD Callback Methods
+// A client enabling notifications is the earliest point at which
+// a notify can reach it, so the initial state sync happens here
+//////////////////////////////////////////////////////////////
+class MyCccdCallbacks: public BLEDescriptorCallbacks {
+    void onWrite(BLEDescriptor* pDescriptor) {
+        if (((BLE2902 *)pDescriptor)->getNotifications()) {
+            Serial.println("Client subscribed, syncing location");
+            recorder.ble(BLE_SUBSCRIBED, pDescriptor->getHandle());
+            locationWasUpdated = true;
+            publishSnapshot(true);
+        }
     }
 };
 
@@ -75,15 +301,16 @@ class MyCharacteristicCallbacks: public BLECharacteristicCallbacks {
     // callback function to support a read request
     void onRead(BLECharacteristic* pCharacteristic) {
         String characteristicUUID = pCharacteristic->getUUID().toString().c_str();
-        String characteristicValue = pCharacteristic->getValue().c_str();
-        Serial.printf("Client JUST read from %s: %s", characteristicUUID, characteristicValue.c_str());
+        if (EVENT_LOG)
+            logEvent("Client JUST read from", characteristicUUID, pCharacteristic->getValue());
     }
     
     // callback function to support a write request
     void onWrite(BLECharacteristic* pCharacteristic) {
         String characteristicUUID = pCharacteristic->getUUID().toString().c_str();
-        String characteristcValue = pCharacteristic->getValue().c_str();
-        Serial.printf("Client JUST wrote to %s: %s", characteristicUUID, characteristcValue.c_str());
+        if (EVENT_LOG)
+            logEvent("Client JUST wrote to", characteristicUUID, pCharacteristic->getValue());
+        recorder.ble(BLE_RX, pCharacteristic->getHandle(), pCharacteristic->getValue().length());
 
         // check if characteristicUUID matches a known UUID
         if (characteristicUUID.equals(READ_WRITE_X_CHARACTERISTIC_UUID)) {
@@ -98,12 +325,42 @@ class MyCharacteristicCallbacks: public BLECharacteristicCallbacks {
             String valYStr = readYValue.c_str();
             yClient = valYStr.toInt();
         }
+        if (characteristicUUID.equals(LOCKSTEP_CHARACTERISTIC_UUID)) {
+            // simulated in loop(), not on the BLE task
+            std::string packet = pCharacteristic->getValue();
+            if (packet.length() == sizeof(LockstepPacket))
+                xQueueSend(lockstepInbox, packet.data(), 0);
+        }
+        if (characteristicUUID.equals(INPUT_CHARACTERISTIC_UUID)) {
+            // simulated in loop(), not on the BLE task
+            std::string batch = pCharacteristic->getValue();
+            if (batch.length() == sizeof(InputBatch))
+                xQueueSend(inputInbox, batch.data(), 0);
+        }
+        if (characteristicUUID.equals(LATENCY_CHARACTERISTIC_UUID)) {
+            // matched to a frame in loop(), not on the BLE task
+            std::string stamp = pCharacteristic->getValue();
+            if (stamp.length() == sizeof(LatencyStamp)) {
+                portENTER_CRITICAL(&clientStampMux);
+                memcpy(&clientStamp, stamp.data(), sizeof(clientStamp));
+                clientStampPending = true;
+                portEXIT_CRITICAL(&clientStampMux);
+            }
+        }
+        if (characteristicUUID.equals(CONTROL_CHARACTERISTIC_UUID)) {
+            // handled in loop(), not on the BLE task; only from the result screen, so a
+            // client that reached game over first can't skip ours
+            std::string command = pCharacteristic->getValue();
+            if (command.length() == 1 && (uint8_t)command[0] == CMD_REMATCH && screen == S_GAME_OVER)
+                rematchRequested = true;
+        }
     }
 
     // callback function to support a Notify request
     void onNotify(BLECharacteristic* pCharacteristic) {
         String characteristicUUID = pCharacteristic->getUUID().toString().c_str();
-        Serial.printf("Client JUST notified about change to %s: %s", characteristicUUID, pCharacteristic->getValue().c_str());
+        if (EVENT_LOG)
+            logEvent("Client JUST notified about change to", characteristicUUID, pCharacteristic->getValue());
     }
 
     // callback function to support when a client subscribes to notifications/indications
@@ -111,70 +368,144 @@ class MyCharacteristicCallbacks: public BLECharacteristicCallbacks {
 
     // calllback function to support a Notify/Indicate Status report
     void onStatus(BLECharacteristic* pCharacteristic, Status s, uint32_t code) {
-        // print appropriate response
-        String characteristicUUID = pCharacteristic->getUUID().toString().c_str();
+        // count failures for ServerLinkStats, then print appropriate response
+        const char *response = nullptr;
         switch(s) {
             case SUCCESS_INDICATE:
                 break;
             case SUCCESS_NOTIFY:
-                Serial.printf("Status for %s: Successful Notification", characteristicUUID.c_str());
+                response = "Successful Notification";
                 break;
             case ERROR_INDICATE_DISABLED:
-                Serial.printf("Status for %s: Failure; Indication Disabled on Client", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_INDICATE_DISABLED]++;
+                response = "Failure; Indication Disabled on Client";
                 break;
             case ERROR_NOTIFY_DISABLED:
-                Serial.printf("Status for %s: Failure; Notification Disabled on Client", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_NOTIFY_DISABLED]++;
+                response = "Failure; Notification Disabled on Client";
                 break;
             case ERROR_GATT:
-                Serial.printf("Status for %s: Failure; GATT Issue", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_GATT]++;
+                response = "Failure; GATT Issue";
                 break;
             case ERROR_NO_CLIENT:
-                Serial.printf("Status for %s: Failure; No BLE Client", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_NO_CLIENT]++;
+                response = "Failure; No BLE Client";
                 break;
             case ERROR_INDICATE_TIMEOUT:
-                Serial.printf("Status for %s: Failure; Indication Timeout", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_INDICATE_TIMEOUT]++;
+                response = "Failure; Indication Timeout";
                 break;
             case ERROR_INDICATE_FAILURE:
-                Serial.printf("Status for %s: Failure; Indication Failure", characteristicUUID.c_str());
+                statusErrors[LINK_ERR_INDICATE_FAILURE]++;
+                response = "Failure; Indication Failure";
                 break;
         }
+        if (EVENT_LOG && response != nullptr)
+            Serial.printf("Status for %s: %s\n", pCharacteristic->getUUID().toString().c_str(), response);
     }    
 
 };
 
+///////////////////////////////////////////////////////////////
+// Clock sync: answers a ClockPing on the BLE task right away,
+// stamped on arrival and just before the notify, so the client
+// can take our time in between out of the round trip
+///////////////////////////////////////////////////////////////
+class MyClockCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        uint32_t receivedUs = micros();
+        std::string value = pCharacteristic->getValue();
+        recorder.ble(BLE_RX, pCharacteristic->getHandle(), value.length());
+        if (value.length() != sizeof(ClockPing))
+            return;
+        ClockPing ping;
+        memcpy(&ping, value.data(), sizeof(ping));
+        ClockPong pong = { ping.seq, ping.clientSendUs, receivedUs, 0 };
+        pong.serverSendUs = micros();
+        pCharacteristic->setValue((uint8_t *)&pong, sizeof(pong));
+        pCharacteristic->notify();
+    }
+};
+
+///////////////////////////////////////////////////////////////
+// Raw GATT server events, passed on by the BLE library after it
+// has handled them: every write that arrives and every notify
+// that goes out, whichever characteristic it is for
+///////////////////////////////////////////////////////////////
+static void linkStatsGattsHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t *param) {
+    switch (event) {
+        case ESP_GATTS_WRITE_EVT:
+            writesReceived++;
+            bytesReceived += param->write.len;
+            break;
+        case ESP_GATTS_CONF_EVT:
+            if (param->conf.status != ESP_GATT_OK)
+                break;
+            notifiesSent++;
+            bytesSent += param->conf.len;
+            break;
+        default:
+            break;
+    }
+}
+
 ///////////////////////////////////////////////////////////////
 // Forward Declarations
 ///////////////////////////////////////////////////////////////
 void broadcastBleServer();
+void bleInitTask(void *parameter);
 void drawScreenTextWithBackground(String text, int backgroundColor);
 
 // Gameplay
-void drawDots(uint32_t serverX, uint32_t serverY, uint32_t clientX, uint32_t clientY);
-void serverAccelIncrement();
-String milis_to_seconds(long milis);
-void playGame();
-void endGame();
-bool checkDistance();
-void warpDot();
+void enterGameOver();
+void pollRematch();
+void startNewMatch();
+void playLockstep();
+void playAuthoritative();
+void queueClientInputs(const InputBatch &batch);
+uint8_t readGamePadInput();
+void publishLinkStats();
+void notifyLatencyStamp();
+bool takeLatencyStamp(LatencyStamp &stamp);
+void measureLatency();
 
 ///////////////////////////////////////////////////////////////
 // Put your setup code here, to run once
 ///////////////////////////////////////////////////////////////
 void setup()
 {
-    // Init device
+    // The match (and lockstep seed) exists before any client can ask for it
+    matchSessionId = esp_random();
+    lockstep.reset(matchSessionId);
+    lockstepInbox = xQueueCreate(16, sizeof(LockstepPacket));
+    gameReset(authority, matchSessionId);
+    inputInbox = xQueueCreate(8, sizeof(InputBatch));
+
+    // Start BLE (controller init + GATT server + advertising) on core 0 first;
+    // it does not depend on the LCD or I2C and is the slowest part of boot
+    bleReady = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(bleInitTask, "bleInit", 4096, NULL, 1, NULL, CORE_BLE);
+
+    // Init device (LCD, power, I2C, SD) while BLE comes up
     M5.begin();
+    setGameLoopPriority(GAME_TASK_PRIORITY);
+    if (RENDER_TASK)
+        game.startRenderTask(RENDER_TASK_PRIORITY, RENDER_DMA);
+    if (CORE_LOAD_REPORT)
+        coreLoad.begin();
+    RecordMode mode = LOCKSTEP_MODE ? MODE_LOCKSTEP : AUTHORITATIVE_MODE ? MODE_AUTHORITATIVE : MODE_POSITIONS;
+    if (MATCH_RECORDING) {
+        if (RECORD_TO_SD)
+            recorder.begin(SD, "server", ROLE_SERVER, mode);
+        else if (LittleFS.begin(true))
+            recorder.begin(LittleFS, "server", ROLE_SERVER, mode);
+        recorder.match(matchSessionId, screen);
+    }
+    if (TELEMETRY)
+        telemetry.begin(Serial, TELEMETRY_BAUD, ROLE_SERVER, mode);
     M5.Lcd.setTextSize(3);
-
-    // Initialize M5Core2 as a BLE server
-    Serial.print("Starting BLE...");
-    String bleDeviceName = "Duct Tape n' Prayer";
-    BLEDevice::init(bleDeviceName.c_str());
-
-    // Broadcast the BLE server
     drawScreenTextWithBackground("Initializing BLE...", TFT_CYAN);
-    broadcastBleServer();
-    drawScreenTextWithBackground("Broadcasting as BLE server named:\n\n" + bleDeviceName, TFT_BLUE);
 
     // Gameplay setup
     if(!gamePad.begin(0x50)){
@@ -183,15 +514,28 @@ void setup()
     }
     gamePad.pinModeBulk(button_mask, INPUT_PULLUP);
     gamePad.setGPIOInterrupts(button_mask, 1);
-    for (int i = 0; i < 10; i++) {
-      bleReadXCharacteristic->setValue(xServer);
-      bleReadYCharacteristic->setValue(yServer);
-      
-      bleReadXCharacteristic->notify();
-      delay(10);
-      bleReadYCharacteristic->notify();
-      delay(500);
-    }
+    game.calibrate();
+
+    // Initial state is sent when a client subscribes (see MyCccdCallbacks), not here
+    xSemaphoreTake(bleReady, portMAX_DELAY);
+    drawScreenTextWithBackground("Broadcasting as BLE server named:\n\n" + bleDeviceName, TFT_BLUE);
+    // Bring-up time: BLE, LCD and gamepad all up and the waiting screen drawn,
+    // whether or not a client ever connects
+    Serial.printf("Boot to ready: %lu ms\n", millis());
+}
+
+///////////////////////////////////////////////////////////////
+// Initializes M5Core2 as a BLE server and broadcasts it
+///////////////////////////////////////////////////////////////
+void bleInitTask(void *parameter)
+{
+    Serial.print("Starting BLE...");
+    BLEDevice::init(bleDeviceName.c_str());
+    BLEDevice::setMTU(BLE_MTU);
+    BLEDevice::setCustomGattsHandler(linkStatsGattsHandler);
+    broadcastBleServer();
+    xSemaphoreGive(bleReady);
+    vTaskDelete(NULL);
 }
 
 ///////////////////////////////////////////////////////////////
@@ -199,41 +543,69 @@ void setup()
 ///////////////////////////////////////////////////////////////
 void loop()
 {
+    uint32_t loopStartUs = micros();
     M5.update();
+    loopCount++;
+    uint32_t networkStartUs = micros();
+    publishLinkStats();
+    uint32_t networkUs = micros() - networkStartUs;
+    if (CORE_LOAD_REPORT)
+        coreLoad.report(CORE_LOAD_REPORT_MS);
+    if (RENDER_REPORT)
+        game.reportRender(CORE_LOAD_REPORT_MS);
     if (deviceConnected) {
-      bool stillPlaying = checkDistance();
-      if (screen == S_GAME && stillPlaying) {
-        playGame();
+      uint32_t gameStartUs = micros();
+      uint32_t notifyUs = 0;
+      if (screen == S_GAME_OVER) {
+        // Back from a disconnect: the result and the rematch hint are gone
+        if (disconnectShown)
+          game.endGame(timer);
+        pollRematch();
+      } else if (LOCKSTEP_MODE) {
+        playLockstep();
+      } else if (AUTHORITATIVE_MODE) {
+        playAuthoritative();
+      } else if (!game.checkDistance()) {
+        enterGameOver();
+      } else {
+        game.play();
+        if (LATENCY_MODE)
+          measureLatency();
         if (locationWasUpdated) {
+        uint32_t notifyStartUs = micros();
         bleReadXCharacteristic->setValue(xServer);
         bleReadYCharacteristic->setValue(yServer);
         
         bleReadXCharacteristic->notify();
+        recorder.ble(BLE_TX, bleReadXCharacteristic->getHandle(), 4);
         delay(10);
         bleReadYCharacteristic->notify();
+        recorder.ble(BLE_TX, bleReadYCharacteristic->getHandle(), 4);
         delay(10);
+        if (LATENCY_MODE)
+          notifyLatencyStamp();
+        notifyUs = micros() - notifyStartUs;
       }
       locationWasUpdated = false;
-      } else {
-        if (timer == 0) {
-        timer = millis();
-        }
-        endGame();
-        delay(50000);
       }
+      disconnectShown = false;
+      recordPosition();
+      telemetry.frame(loopStartUs, networkUs + notifyUs, micros() - gameStartUs - notifyUs, game.takeRenderUs(), screen);
     } else if (previouslyConnected) {
-      drawScreenTextWithBackground("Disconnected. Reset M5 device to reinitialize BLE.", TFT_RED); // Give feedback on screen
-      timer = 0;
+      // Only drawn when it isn't showing yet; we are already advertising again (see MyServerCallbacks::onDisconnect)
+      drawScreenTextWithBackground("Disconnected. Waiting for the client to reconnect...", TFT_RED); // Give feedback on screen
+      disconnectShown = true;
     }
+    telemetry.stats(TELEMETRY_STATS_MS, 0);     // the server answers clock pings, it doesn't time them
 }
 
 ///////////////////////////////////////////////////////////////
-// Colors the background and then writes the text on top
+// Colors the background and then writes the text on top (only
+// what changed since the last call, see StatusScreen)
 ///////////////////////////////////////////////////////////////
 void drawScreenTextWithBackground(String text, int backgroundColor) {
-    M5.Lcd.fillScreen(backgroundColor);
-    M5.Lcd.setCursor(0,0);
-    M5.Lcd.println(text);
+    game.flushRender();
+    status.show(text, backgroundColor);
 }
 
 ///////////////////////////////////////////////////////////////
@@ -246,7 +618,7 @@ void broadcastBleServer() {
     Serial.println("Created Server");
     bleServer->setCallbacks(new MyServerCallbacks());
     Serial.println("Set Callbacks");
-    bleService = bleServer->createService(SERVICE_UUID);
+    bleService = bleServer->createService(BLEUUID(SERVICE_UUID), SERVICE_HANDLES);
     Serial.println("Created Service");
     
     bleReadXCharacteristic = bleService->createCharacteristic(READ_X_CHARACTERISTIC_UUID,
@@ -255,6 +627,9 @@ void broadcastBleServer() {
         BLECharacteristic::PROPERTY_INDICATE
     );
     bleReadXCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+    BLE2902 *readXCccd = new BLE2902();
+    readXCccd->setCallbacks(new MyCccdCallbacks());
+    bleReadXCharacteristic->addDescriptor(readXCccd);
     Serial.println("Created Characteristic");
 
     bleReadXCharacteristic->setValue(xServer);
@@ -267,16 +642,70 @@ void broadcastBleServer() {
     );
     bleReadYCharacteristic->setValue(yServer);
     bleReadYCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+    BLE2902 *readYCccd = new BLE2902();
+    readYCccd->setCallbacks(new MyCccdCallbacks());
+    bleReadYCharacteristic->addDescriptor(readYCccd);
 
     bleReadWriteXCharacteristic = bleService->createCharacteristic(READ_WRITE_X_CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_WRITE
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
     );
     bleReadWriteXCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
 
     bleReadWriteYCharacteristic = bleService->createCharacteristic(READ_WRITE_Y_CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_WRITE
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
     );
     bleReadWriteYCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+
+    bleStateCharacteristic = bleService->createCharacteristic(STATE_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    BLE2902 *stateCccd = new BLE2902();
+    stateCccd->setCallbacks(new MyCccdCallbacks());
+    bleStateCharacteristic->addDescriptor(stateCccd);
+    publishSnapshot(false);
+
+    bleControlCharacteristic = bleService->createCharacteristic(CONTROL_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    bleControlCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+
+    bleLockstepCharacteristic = bleService->createCharacteristic(LOCKSTEP_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    bleLockstepCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+    bleLockstepCharacteristic->addDescriptor(new BLE2902());
+
+    bleInputCharacteristic = bleService->createCharacteristic(INPUT_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    bleInputCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+
+    bleClockCharacteristic = bleService->createCharacteristic(CLOCK_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE_NR |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    bleClockCharacteristic->setCallbacks(new MyClockCallbacks());
+    bleClockCharacteristic->addDescriptor(new BLE2902());
+
+    bleLatencyCharacteristic = bleService->createCharacteristic(LATENCY_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_WRITE_NR |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    bleLatencyCharacteristic->setCallbacks(new MyCharacteristicCallbacks());
+    bleLatencyCharacteristic->addDescriptor(new BLE2902());
+
+    bleLinkStatsCharacteristic = bleService->createCharacteristic(LINK_STATS_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    bleLinkStatsCharacteristic->addDescriptor(new BLE2902());
     bleService->start();
 
     // Start broadcasting (advertising) BLE service
@@ -288,111 +717,288 @@ void broadcastBleServer() {
     Serial.println("Characteristic defined...you can connect with your phone!"); 
 }
 
-bool checkDistance() {
-  long distance = abs(sqrt(pow((xServer - xClient), 2) + pow((yServer - yClient), 2)));
-  if (distance <= 30) {
-    return false;
-  }
-  return true;
+///////////////////////////////////////////////////////////////
+// Updates the match snapshot a (re)connecting client resumes from
+///////////////////////////////////////////////////////////////
+void publishSnapshot(bool notify) {
+    const GameState &simulation = AUTHORITATIVE_MODE ? authority : lockstep.state;
+    MatchSnapshot snapshot;
+    snapshot.sessionId = matchSessionId;
+    if (!previouslyConnected)
+        snapshot.elapsedMs = 0;
+    else
+        snapshot.elapsedMs = (deviceConnected ? millis() : disconnectTime) - matchStartTime;
+    snapshot.xServer = xServer;
+    snapshot.yServer = yServer;
+    snapshot.xClient = xClient;
+    snapshot.yClient = yClient;
+    snapshot.screen = screen;
+    snapshot.tick = simulation.tick;
+    snapshot.rngState = simulation.rng.state;
+    snapshot.serverAcceleration = acceleration;
+    snapshot.clientAcceleration = simulation.client.acceleration;
+    snapshot.serverTimeUs = micros();
+    bleStateCharacteristic->setValue((uint8_t *)&snapshot, sizeof(snapshot));
+    if (notify) {
+        bleStateCharacteristic->notify();
+        recorder.ble(BLE_TX, bleStateCharacteristic->getHandle(), sizeof(snapshot));
+    }
 }
 
-void serverAccelIncrement() {
-  if (acceleration == 5) {
-    acceleration = 1;
-  } else {
-    acceleration++;
-  }
+///////////////////////////////////////////////////////////////
+// Sets the link stats characteristic from the counters once a
+// second, and notifies it while a client is connected
+///////////////////////////////////////////////////////////////
+void publishLinkStats() {
+    unsigned long now = millis();
+    if (now - lastLinkStats < LINK_STATS_INTERVAL_MS || bleLinkStatsCharacteristic == nullptr)
+        return;
+    float seconds = (now - lastLinkStats) / 1000.0;
+    lastLinkStats = now;
+
+    ServerLinkStats stats;
+    stats.uptimeMs = now;
+    stats.notifiesSent = notifiesSent;
+    stats.writesReceived = writesReceived;
+    uint32_t sent = bytesSent, received = bytesReceived;
+    stats.txBytesPerSecond = min((sent - publishedBytesSent) / seconds, 65535.0f);
+    stats.rxBytesPerSecond = min((received - publishedBytesReceived) / seconds, 65535.0f);
+    stats.loopHz = min((loopCount - publishedLoopCount) / seconds, 65535.0f);
+    for (int i = 0; i < LINK_STATUS_ERRORS; i++)
+        stats.statusErrors[i] = statusErrors[i];
+    publishedBytesSent = sent;
+    publishedBytesReceived = received;
+    publishedLoopCount = loopCount;
+
+    bleLinkStatsCharacteristic->setValue((uint8_t *)&stats, sizeof(stats));
+    if (deviceConnected)
+        bleLinkStatsCharacteristic->notify();
 }
 
-String milis_to_seconds(long milis) {
-    unsigned long seconds = milis / 1000;
-    String secondStr = seconds < 10 ? "0" + String(seconds) : String(seconds);
-    unsigned long miliseconds = milis % 60;
-    String milisecondsStr = miliseconds < 10 ? "0" + String(miliseconds) : String(miliseconds);
-    return secondStr + "." + milisecondsStr + "s";
+///////////////////////////////////////////////////////////////
+// Logs the dots whenever either of them has moved
+///////////////////////////////////////////////////////////////
+void recordPosition() {
+    int position[4] = { xServer, yServer, xClient, yClient };
+    if (memcmp(position, recordedPosition, sizeof(position)) == 0)
+        return;
+    memcpy(recordedPosition, position, sizeof(position));
+    recorder.position(xServer, yServer, xClient, yClient);
 }
 
-void endGame() {
-  M5.Lcd.fillScreen(TFT_MAGENTA);
-  M5.Lcd.setTextColor(TFT_BLACK);
-  M5.Lcd.setTextSize(3);
-  M5.Lcd.drawString("GAME OVER", M5.Lcd.width() / 4, M5.Lcd.height() / 2 - 30);
-  M5.Lcd.setTextSize(2);
-  M5.Lcd.drawString("YOU LASTED FOR", M5.Lcd.width() / 4, M5.Lcd.height() / 2);
-  M5.Lcd.drawString(milis_to_seconds(timer), M5.Lcd.width() / 4, M5.Lcd.height() - 100);
+///////////////////////////////////////////////////////////////
+// Latency measurement (LATENCY_MODE): our move's stamp follows
+// its position notifications
+///////////////////////////////////////////////////////////////
+void notifyLatencyStamp() {
+    LatencyStamp stamp = { latencySeq++, (int16_t)xServer, (int16_t)yServer, moveSampleUs };
+    bleLatencyCharacteristic->setValue((uint8_t *)&stamp, sizeof(stamp));
+    bleLatencyCharacteristic->notify();
 }
 
-void playGame() {
-  M5.Lcd.fillScreen(TFT_BLACK);
-  // Reverse x/y values to match joystick orientation
-  int x = 1023 - gamePad.analogRead(14);
-  int y = 1023 - gamePad.analogRead(15);
-
-  // Left & Right For Joystick
-  if (x > 600) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((xServer + 1) < 320) {
-        xServer++;
-        locationWasUpdated = true;
-      }
-    }
-  } else if (x < 500) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((xServer - 1) > 0) {
-        xServer--;
-        locationWasUpdated = true;
-      }
-    }
+bool takeLatencyStamp(LatencyStamp &stamp) {
+    if (!clientStampPending)
+        return false;
+    portENTER_CRITICAL(&clientStampMux);
+    stamp = clientStamp;
+    clientStampPending = false;
+    portEXIT_CRITICAL(&clientStampMux);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////
+// Called right after each frame is drawn: notes where it drew
+// the client's dot, and times the client's move once the frame
+// that first showed its position is known (the stamp arrives
+// after the position, often a frame or more after it is drawn)
+///////////////////////////////////////////////////////////////
+void measureLatency() {
+    LatencyStamp stamp;
+    if (takeLatencyStamp(stamp))
+        clientMoves.expect(stamp.x, stamp.y, stamp.sampleUs);
+    clientMoves.drawn(xClient, yClient, micros());
+    int32_t latencyUs;
+    if (clientMoves.take(latencyUs))
+        clientToServer.add(latencyUs);
+
+    if (millis() - lastLatencyReport < LATENCY_REPORT_MS)
+        return;
+    lastLatencyReport = millis();
+    clientToServer.print(Serial, "Latency client -> server");
+}
+
+///////////////////////////////////////////////////////////////
+// Game over is a state, not a pause: the result is drawn once
+// and loop() keeps servicing BLE while waiting for a rematch
+///////////////////////////////////////////////////////////////
+void enterGameOver() {
+  screen = S_GAME_OVER;
+  rematchRequested = false;
+  rematchStartHeld = true;
+  timer = millis() - matchStartTime;
+  game.endGame(timer);
+  publishSnapshot(true);
+  recorder.match(matchSessionId, screen);
+}
+
+///////////////////////////////////////////////////////////////
+// Either player can start a rematch: START/BtnA here, or the
+// client writing CMD_REMATCH to the control characteristic.
+// START counts when pressed, so holding it through the collision
+// doesn't skip the result screen.
+///////////////////////////////////////////////////////////////
+void pollRematch() {
+  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
+  bool startDown = !(buttons & (1UL << BUTTON_START));
+  bool startPressed = startDown && !rematchStartHeld;
+  rematchStartHeld = startDown;
+  if (M5.BtnA.wasPressed() || startPressed || rematchRequested) {
+    rematchRequested = false;
+    startNewMatch();
   }
+}
 
-  if (y < 480) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((yServer + 1) < 240) {
-        yServer++;
-        locationWasUpdated = true;
-      }
-    }
-  } else if (y > 560) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((yServer - 1) > 0) {
-        yServer--;
-        locationWasUpdated = true;
-      }
-    }
+///////////////////////////////////////////////////////////////
+// Resets the match on this side and pushes the new session to
+// the client, which resets itself from the snapshot
+///////////////////////////////////////////////////////////////
+void startNewMatch() {
+  Serial.println("Starting rematch");
+  xServer = SERVER_START_X;
+  yServer = SERVER_START_Y;
+  xClient = CLIENT_START_X;
+  yClient = CLIENT_START_Y;
+  acceleration = 1;
+  timer = 0;
+  matchSessionId = esp_random();
+  matchStartTime = millis();
+  screen = S_GAME;
+  locationWasUpdated = true;
+  lockstep.reset(matchSessionId);
+  gameReset(authority, matchSessionId);
+  clientInputCount = 0;
+  clientInput = 0;
+  publishSnapshot(true);
+  recorder.match(matchSessionId, screen);
+}
+
+///////////////////////////////////////////////////////////////
+// Lockstep replacement for game.play(): sample and send our input
+// once per tick, then simulate every tick both inputs are in
+///////////////////////////////////////////////////////////////
+void playLockstep() {
+  LockstepPacket packet;
+  if (lockstepResync) {
+    // Client (re)connected: drop its old inputs and restart the exchange from
+    // the state it is about to adopt from our snapshot
+    lockstepResync = false;
+    xQueueReset(lockstepInbox);
+    lockstep.resume();
+    publishSnapshot(true);
+  }
+  while (xQueueReceive(lockstepInbox, &packet, 0) == pdTRUE) {
+    int added = lockstep.addRemoteInput(packet);
+    for (int i = added - 1; i >= 0; i--)
+      recorder.input(SIDE_REMOTE, packet.inputs[i]);
   }
 
-  // For the gamepad buttons
-  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
-  if (! (buttons & (1UL << BUTTON_SELECT))) {
-    serverAccelIncrement();
-    Serial.print("Button Accel: "); Serial.print(acceleration);
-    delay(500);
+  if (millis() - lastTickTime >= LOCKSTEP_TICK_MS) {
+    lastTickTime = millis();
+    lockstep.addLocalInput(readGamePadInput(), packet);
+    bleLockstepCharacteristic->setValue((uint8_t *)&packet, sizeof(packet));
+    bleLockstepCharacteristic->notify();
+    recorder.ble(BLE_TX, bleLockstepCharacteristic->getHandle(), sizeof(packet));
   }
-  if (! (buttons & (1UL << BUTTON_START))) {
-    warpDot();
-    delay(1000);
+
+  if (lockstep.advance() == 0)
+    return;
+  xServer = lockstep.state.server.x;
+  yServer = lockstep.state.server.y;
+  xClient = lockstep.state.client.x;
+  yClient = lockstep.state.client.y;
+  acceleration = lockstep.state.server.acceleration;
+  recordPosition();
+  if (lockstep.state.over) {
+    enterGameOver();
+    return;
   }
+  game.render();
+}
 
-  drawDots(xServer, yServer, xClient, yClient); 
+///////////////////////////////////////////////////////////////
+// Authoritative replacement for game.play(): step the one
+// simulation per tick with our input and the client's next
+// forwarded sample, then broadcast the result
+///////////////////////////////////////////////////////////////
+void playAuthoritative() {
+  InputBatch batch;
+  if (inputResync) {
+    // Client (re)connected: its sample numbers start over
+    inputResync = false;
+    xQueueReset(inputInbox);
+    clientInputCount = 0;
+    lastInputSeq = 0;
+  }
+  while (xQueueReceive(inputInbox, &batch, 0) == pdTRUE)
+    queueClientInputs(batch);
+
+  if (millis() - lastTickTime < LOCKSTEP_TICK_MS)
+    return;
+  lastTickTime = millis();
+
+  // Missing samples (late or lost writes) hold the client's last input
+  if (clientInputCount > 0) {
+    clientInput = clientInputs[clientInputHead];
+    clientInputHead = (clientInputHead + 1) % sizeof(clientInputs);
+    clientInputCount--;
+  }
+  recorder.input(SIDE_REMOTE, clientInput);
+  gameStep(authority, readGamePadInput(), clientInput);
+  xServer = authority.server.x;
+  yServer = authority.server.y;
+  xClient = authority.client.x;
+  yClient = authority.client.y;
+  acceleration = authority.server.acceleration;
+  recordPosition();
+  if (authority.over) {
+    enterGameOver();
+    return;
+  }
+  publishSnapshot(true);
+  game.render();
 }
 
-void warpDot() {
-  // create random ints for x and y and have the dot drawn there next
-  int randx = rand() % M5.Lcd.width();
-  int randy = rand() % M5.Lcd.height();
-  xServer = randx;
-  yServer = randy;
-  
-  bleReadXCharacteristic->setValue(xServer);
-  bleReadYCharacteristic->setValue(yServer);
-
-  bleReadXCharacteristic->notify();
-  delay(10);
-  bleReadYCharacteristic->notify();
-  delay(10);
+///////////////////////////////////////////////////////////////
+// Queues the samples of a batch we have not seen yet. Batches
+// overlap, so a lost write is covered by the next one.
+///////////////////////////////////////////////////////////////
+void queueClientInputs(const InputBatch &batch) {
+  for (int i = 0; i < INPUT_BATCH_SIZE; i++) {
+    uint16_t seq = batch.seq - (INPUT_BATCH_SIZE - 1 - i);
+    if ((int16_t)(seq - lastInputSeq) <= 0)
+      continue;
+    lastInputSeq = seq;
+    if (clientInputCount == sizeof(clientInputs)) {
+      // Too far behind the client: drop the oldest sample rather than add latency
+      clientInputHead = (clientInputHead + 1) % sizeof(clientInputs);
+      clientInputCount--;
+    }
+    clientInputs[(clientInputHead + clientInputCount) % sizeof(clientInputs)] = batch.inputs[i];
+    clientInputCount++;
+  }
 }
 
-void drawDots(uint32_t serverX, uint32_t serverY, uint32_t clientX, uint32_t clientY){
-  M5.Lcd.drawPixel(serverX, serverY, TFT_RED);
-  M5.Lcd.drawPixel(clientX, clientY, TFT_BLUE);
-}
\ No newline at end of file
+///////////////////////////////////////////////////////////////
+// Joystick and buttons as lockstep input bits, from the same
+// filtered stick as game.play()
+///////////////////////////////////////////////////////////////
+uint8_t readGamePadInput() {
+  game.joystick().read(gamePad);
+  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
+  uint8_t input = game.joystick().direction();
+
+  if (!(buttons & (1UL << BUTTON_SELECT))) input |= IN_SELECT;
+  if (!(buttons & (1UL << BUTTON_START))) input |= IN_START;
+  recorder.input(SIDE_LOCAL, input);
+  return input;
+}
@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////
+// Load generator for a spare Core2: connects to the game server
+// like the client does and writes X position updates at a fixed
+// rate, the same decimal strings the client's playGame() sends.
+// BtnA halves the rate, BtnC doubles it, BtnB resets the stats.
+//
+// Every WRITE_RSP_EVERY-th update is written with a response
+// and timed: the response waits for the server's BLE task to
+// get through everything queued ahead of it, so the round trip
+// shows when onWrite() + the notify path stop keeping up.
+// Writes the stack refuses (congested) count as dropped.
+///////////////////////////////////////////////////////////////
+#include <BLEDevice.h>
+#include <M5Core2.h>
+#include <algorithm>
+#include <vector>
+
+///////////////////////////////////////////////////////////////
+// Variables
+///////////////////////////////////////////////////////////////
+static BLEClient *bleClient = nullptr;
+static BLERemoteCharacteristic *bleReadWriteXCharacteristic;
+static BLEAdvertisedDevice *bleRemoteServer;
+static bool doConnect = false;
+bool deviceConnected = false;
+String bleServerName = "Duct Tape n' Prayer";
+
+// Unique IDs (must match the server)
+static BLEUUID SERVICE_UUID("7d7a7768-a9d0-4fb8-bf2b-fc994c662eb6");
+static BLEUUID READ_WRITE_X_CHARACTERISTIC_UUID("1da468d6-993d-4387-9e71-1c826b10fff9");
+
+// Load
+#define WRITE_RSP_EVERY 10
+#define REPORT_MS 1000
+static uint32_t writesPerSecond = 50;
+static unsigned long nextWriteUs = 0;
+static uint32_t writeCount = 0;
+
+// Stats for the current report period
+static uint32_t periodSent = 0;
+static uint32_t periodDropped = 0;
+static uint32_t totalSent = 0;
+static uint32_t totalDropped = 0;
+static std::vector<uint32_t> roundTripsUs;
+static unsigned long lastReport = 0;
+
+///////////////////////////////////////////////////////////////
+// Forward Declarations
+///////////////////////////////////////////////////////////////
+void drawScreenTextWithBackground(String text, int backgroundColor);
+bool connectToServer();
+void sendUpdate();
+void report();
+
+///////////////////////////////////////////////////////////////
+// BLE Client Callback Methods
+///////////////////////////////////////////////////////////////
+class MyClientCallback : public BLEClientCallbacks
+{
+    void onConnect(BLEClient *pclient)
+    {
+        deviceConnected = true;
+        Serial.println("Device connected...");
+    }
+
+    void onDisconnect(BLEClient *pclient)
+    {
+        deviceConnected = false;
+        doConnect = true;
+        Serial.println("Device disconnected...");
+    }
+};
+
+class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks
+{
+    void onResult(BLEAdvertisedDevice advertisedDevice)
+    {
+        if (advertisedDevice.haveServiceUUID() &&
+                advertisedDevice.isAdvertisingService(SERVICE_UUID) &&
+                advertisedDevice.getName() == bleServerName.c_str()) {
+            BLEDevice::getScan()->stop();
+            bleRemoteServer = new BLEAdvertisedDevice(advertisedDevice);
+            doConnect = true;
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////
+// Put your setup code here, to run once
+///////////////////////////////////////////////////////////////
+void setup()
+{
+    M5.begin();
+    M5.Lcd.setTextSize(2);
+
+    BLEDevice::init("");
+    bleClient = BLEDevice::createClient();
+    bleClient->setClientCallbacks(new MyClientCallback());
+
+    BLEScan *bleScan = BLEDevice::getScan();
+    bleScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
+    bleScan->setInterval(160);
+    bleScan->setWindow(50);
+    bleScan->setActiveScan(true);
+    bleScan->start(0, nullptr, false);
+    drawScreenTextWithBackground("Load generator\n\nScanning for " + bleServerName, TFT_BLUE);
+}
+
+///////////////////////////////////////////////////////////////
+// Put your main code here, to run repeatedly
+///////////////////////////////////////////////////////////////
+void loop()
+{
+    M5.update();
+    if (doConnect && bleRemoteServer != nullptr) {
+        doConnect = false;
+        if (!connectToServer()) {
+            drawScreenTextWithBackground("Connect failed, retrying...", TFT_RED);
+            delay(1000);
+            doConnect = true;
+        }
+    }
+
+    if (M5.BtnA.wasPressed() && writesPerSecond > 1)
+        writesPerSecond /= 2;
+    if (M5.BtnC.wasPressed() && writesPerSecond < 4096)
+        writesPerSecond *= 2;
+    if (M5.BtnB.wasPressed()) {
+        totalSent = 0;
+        totalDropped = 0;
+    }
+
+    if (deviceConnected && (long)(micros() - nextWriteUs) >= 0) {
+        nextWriteUs += 1000000 / writesPerSecond;
+        // Don't try to make up for a stall with a burst
+        if ((long)(micros() - nextWriteUs) > 100000)
+            nextWriteUs = micros();
+        sendUpdate();
+    }
+
+    if (millis() - lastReport >= REPORT_MS) {
+        lastReport = millis();
+        report();
+    }
+}
+
+bool connectToServer()
+{
+    Serial.printf("Forming a connection to %s\n", bleRemoteServer->getName().c_str());
+    if (!bleClient->connect(bleRemoteServer))
+        return false;
+    BLERemoteService *bleRemoteService = bleClient->getService(SERVICE_UUID);
+    if (bleRemoteService == nullptr) {
+        bleClient->disconnect();
+        return false;
+    }
+    bleReadWriteXCharacteristic = bleRemoteService->getCharacteristic(READ_WRITE_X_CHARACTERISTIC_UUID);
+    if (bleReadWriteXCharacteristic == nullptr) {
+        bleClient->disconnect();
+        return false;
+    }
+    nextWriteUs = micros();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////
+// One position update, as the client would send it
+///////////////////////////////////////////////////////////////
+void sendUpdate()
+{
+    String value = String(10 + writeCount % 300);
+    writeCount++;
+    periodSent++;
+    totalSent++;
+
+    if (writeCount % WRITE_RSP_EVERY == 0) {
+        unsigned long start = micros();
+        bleReadWriteXCharacteristic->writeValue((uint8_t *)value.c_str(), value.length(), true);
+        roundTripsUs.push_back(micros() - start);
+        return;
+    }
+    esp_err_t status = esp_ble_gattc_write_char(bleClient->getGattcIf(), bleClient->getConnId(),
+        bleReadWriteXCharacteristic->getHandle(), value.length(), (uint8_t *)value.c_str(),
+        ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (status != ESP_OK) {
+        periodDropped++;
+        totalDropped++;
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// Once a second: offered and achieved rate, drops and the
+// round trip percentiles, on the LCD and the serial port
+///////////////////////////////////////////////////////////////
+void report()
+{
+    uint32_t p50 = 0, p99 = 0, maxUs = 0;
+    if (!roundTripsUs.empty()) {
+        std::sort(roundTripsUs.begin(), roundTripsUs.end());
+        p50 = roundTripsUs[(roundTripsUs.size() - 1) / 2];
+        p99 = roundTripsUs[(roundTripsUs.size() - 1) * 99 / 100];
+        maxUs = roundTripsUs.back();
+    }
+    uint32_t achieved = (periodSent - periodDropped) * 1000 / REPORT_MS;
+    Serial.printf("rate %u/s: sent %u, dropped %u, rtt p50 %.1f p99 %.1f max %.1f ms\n", writesPerSecond,
+        periodSent, periodDropped, p50 / 1000.0, p99 / 1000.0, maxUs / 1000.0);
+
+    M5.Lcd.fillScreen(deviceConnected ? TFT_BLACK : TFT_RED);
+    M5.Lcd.setCursor(0, 0);
+    M5.Lcd.printf("Load generator\n\n");
+    M5.Lcd.printf("Offered:  %u/s\n", writesPerSecond);
+    M5.Lcd.printf("Achieved: %u/s\n", achieved);
+    M5.Lcd.printf("Dropped:  %u (total %u/%u)\n\n", periodDropped, totalDropped, totalSent);
+    M5.Lcd.printf("RTT p50:  %.1f ms\n", p50 / 1000.0);
+    M5.Lcd.printf("RTT p99:  %.1f ms\n", p99 / 1000.0);
+    M5.Lcd.printf("RTT max:  %.1f ms\n\n", maxUs / 1000.0);
+    M5.Lcd.printf("A: rate/2  B: reset  C: rate*2");
+
+    periodSent = 0;
+    periodDropped = 0;
+    roundTripsUs.clear();
+}
+
+void drawScreenTextWithBackground(String text, int backgroundColor) {
+    M5.Lcd.fillScreen(backgroundColor);
+    M5.Lcd.setCursor(0,0);
+    M5.Lcd.println(text);
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////
+// Wire formats shared by the server and client sketches
+///////////////////////////////////////////////////////////////
+#ifndef GAME_PROTOCOL_H
+#define GAME_PROTOCOL_H
+
+#include <stdint.h>
+
+// ATT MTU both sides ask for (BLEDevice::setMTU right after init). The default
+// (23) only carries 20-byte values: MatchSnapshot notifies would be cut short
+// and dropped by the client's length check, and its reads would come back short.
+#define BLE_MTU 64
+#define BLE_MAX_VALUE (BLE_MTU - 3)     // ATT notify / read response header
+
+// Commands a client writes to the server's control characteristic
+enum ControlCommand : uint8_t {
+    CMD_REMATCH = 1,        // Start a new match from the game over screen
+};
+
+// Match state published by the server on the state characteristic.
+// A (re)connecting client reads it to resume the match in progress
+// instead of starting over from its boot-time defaults.
+struct __attribute__((packed)) MatchSnapshot {
+    uint32_t sessionId;     // Random per match; changes when a new match starts
+    uint32_t elapsedMs;     // Match time so far (paused while disconnected)
+    int16_t xServer;
+    int16_t yServer;
+    int16_t xClient;
+    int16_t yClient;
+    uint8_t screen;         // Screen enum value (S_GAME, S_GAME_OVER)
+
+    // Lockstep simulation state at `tick` (see lib/GameCore/src/lockstep.h)
+    uint32_t tick;
+    uint32_t rngState;
+    uint8_t serverAcceleration;
+    uint8_t clientAcceleration;
+
+    uint32_t serverTimeUs;  // Server micros() when the snapshot was taken (see ClockPong)
+};
+static_assert(sizeof(MatchSnapshot) <= BLE_MAX_VALUE, "MatchSnapshot must fit one notification at BLE_MTU");
+
+// Clock sync (lib/GameCore/src/clock_sync.h): the client writes a ClockPing to
+// the clock characteristic and the server notifies it straight back as a
+// ClockPong with its own receive and send times. The server's micros() is the
+// shared timebase.
+struct __attribute__((packed)) ClockPing {
+    uint16_t seq;
+    uint32_t clientSendUs;
+};
+struct __attribute__((packed)) ClockPong {
+    uint16_t seq;
+    uint32_t clientSendUs;
+    uint32_t serverReceiveUs;
+    uint32_t serverSendUs;
+};
+
+// Latency measurement mode: whoever moves its dot sends a LatencyStamp on the
+// latency characteristic right after the position (client: write, server:
+// notify), with the time the joystick sample behind the move was taken on the
+// shared timebase. The receiver matches it to the frame that first drew its
+// peer's dot at (x, y), which may be before the stamp arrives (LatencyMatcher).
+struct __attribute__((packed)) LatencyStamp {
+    uint16_t seq;
+    int16_t x;
+    int16_t y;
+    uint32_t sampleUs;      // Server micros() (the client converts with its ClockSync)
+};
+
+// Server diagnostics on the link stats characteristic, published (read and
+// notify) once a second: what the server sees of the link, so the client can
+// show it next to its own and the server can be watched without a USB cable.
+// Larger than the default ATT MTU allows, like MatchSnapshot (see BLE_MTU).
+enum LinkStatusError : uint8_t {   // BLECharacteristicCallbacks::onStatus() failures
+    LINK_ERR_INDICATE_DISABLED,
+    LINK_ERR_NOTIFY_DISABLED,
+    LINK_ERR_GATT,
+    LINK_ERR_NO_CLIENT,
+    LINK_ERR_INDICATE_TIMEOUT,
+    LINK_ERR_INDICATE_FAILURE,
+    LINK_STATUS_ERRORS
+};
+struct __attribute__((packed)) ServerLinkStats {
+    uint32_t uptimeMs;
+    uint32_t notifiesSent;      // Since boot
+    uint32_t writesReceived;
+    uint16_t txBytesPerSecond;  // Notified / written payload bytes over the last second
+    uint16_t rxBytesPerSecond;
+    uint16_t loopHz;            // loop() iterations over the last second
+    uint16_t statusErrors[LINK_STATUS_ERRORS];
+};
+static_assert(sizeof(ServerLinkStats) <= BLE_MAX_VALUE, "ServerLinkStats must fit one notification at BLE_MTU");
+
+// Server-authoritative mode: the client writes its input samples (InputBits,
+// one per tick) to the input characteristic and the server runs the only
+// simulation, notifying a MatchSnapshot every tick. Game over is the snapshot
+// whose screen changes to S_GAME_OVER.
+#define INPUT_BATCH_TICKS 2     // New samples per batch (one write every 2 ticks)
+#define INPUT_BATCH_SIZE 4      // Samples per batch; the older ones repeat the last batch
+struct __attribute__((packed)) InputBatch {
+    uint16_t seq;                       // Sample number of inputs[INPUT_BATCH_SIZE - 1]
+    uint8_t inputs[INPUT_BATCH_SIZE];   // Oldest first
+};
+
+#endif
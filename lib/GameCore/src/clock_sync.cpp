@@ -0,0 +1,92 @@
+#include "clock_sync.h"
+
+void ClockSync::reset() {
+    head = 0;
+    count = 0;
+    bestIndex = 0;
+    hasAnchor = false;
+    drift = 0;
+    driftError = 0;
+    hasDrift = false;
+}
+
+bool ClockSync::addSample(uint32_t localSendUs, uint32_t remoteReceiveUs, uint32_t remoteSendUs,
+                          uint32_t localReceiveUs) {
+    int32_t elapsed = (int32_t)(localReceiveUs - localSendUs);
+    int32_t held = (int32_t)(remoteSendUs - remoteReceiveUs);
+    if (elapsed < 0 || held < 0 || held > elapsed)
+        return false;
+
+    Sample sample;
+    sample.roundTripUs = elapsed - held;
+    sample.localUs = localSendUs + (uint32_t)elapsed / 2;
+    sample.offsetUs = remoteReceiveUs - localSendUs - sample.roundTripUs / 2;
+
+    // Far from where the estimate says it should be: the peer's clock restarted
+    if (synced()) {
+        int32_t residual = (int32_t)(sample.localUs + sample.offsetUs - toRemote(sample.localUs));
+        uint32_t distance = residual < 0 ? -(uint32_t)residual : residual;
+        if (distance > CLOCK_STEP_US + sample.roundTripUs / 2 + errorUs(sample.localUs))
+            reset();
+    }
+
+    window[head] = sample;
+    head = (head + 1) % CLOCK_SYNC_WINDOW;
+    if (count < CLOCK_SYNC_WINDOW)
+        count++;
+    update();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////
+// Best recent sample (shortest round trip), and the drift
+// between it and the anchor once they are far enough apart
+///////////////////////////////////////////////////////////////
+void ClockSync::update() {
+    bestIndex = 0;
+    for (uint8_t i = 1; i < count; i++)
+        if (window[i].roundTripUs < window[bestIndex].roundTripUs)
+            bestIndex = i;
+
+    // The first full window's best sample anchors the drift measurement
+    if (!hasAnchor) {
+        if (count == CLOCK_SYNC_WINDOW) {
+            anchor = best();
+            hasAnchor = true;
+        }
+        return;
+    }
+    uint32_t span = best().localUs - anchor.localUs;
+    if (span > CLOCK_ANCHOR_MAX_SPAN_US) {
+        // Keeps the last measurement until the new anchor is old enough
+        anchor = best();
+        return;
+    }
+    if (span < CLOCK_DRIFT_MIN_SPAN_US)
+        return;
+    double measured = (double)(int32_t)(best().offsetUs - anchor.offsetUs) / span;
+    if (measured * 1e6 > CLOCK_MAX_DRIFT_PPM || measured * 1e6 < -CLOCK_MAX_DRIFT_PPM)
+        return;
+    drift = measured;
+    driftError = (best().roundTripUs / 2 + anchor.roundTripUs / 2) / (double)span;
+    hasDrift = true;
+}
+
+uint32_t ClockSync::toRemote(uint32_t localUs) const {
+    const Sample &reference = best();
+    int32_t since = (int32_t)(localUs - reference.localUs);
+    return localUs + reference.offsetUs + (int32_t)(since * drift);
+}
+
+uint32_t ClockSync::toLocal(uint32_t remoteUs) const {
+    // The drift term is tiny, so evaluating it at the undrifted guess is enough
+    uint32_t guess = remoteUs - best().offsetUs;
+    return remoteUs - (toRemote(guess) - guess);
+}
+
+uint32_t ClockSync::errorUs(uint32_t localUs) const {
+    const Sample &reference = best();
+    int32_t since = (int32_t)(localUs - reference.localUs);
+    uint32_t age = since < 0 ? -(uint32_t)since : since;
+    return reference.roundTripUs / 2 + (uint32_t)(age * driftErrorPpm() / 1e6) + 1;
+}
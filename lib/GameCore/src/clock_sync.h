@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////
+// NTP-style clock synchronisation over the game link: maps our
+// micros() onto the peer's (the server's, which is the shared
+// timebase) with an offset, a drift and an error bound.
+//
+// Each exchange gives four timestamps: we send at t0, the peer
+// receives at t1 and answers at t2, the answer arrives at t3.
+//   round trip = (t3 - t0) - (t2 - t1)
+//   offset     = (t1 - t0) - round trip / 2
+// The offset is exact up to half the round trip (the unknown
+// split between the two directions), so the estimate is taken
+// from the recent sample with the shortest round trip. BLE
+// delays come in connection intervals, milliseconds of noise
+// against a drift of tens of ppm, so drift is measured against
+// an anchor sample at least 30 s older, and its uncertainty
+// (both samples' half round trips over the span) goes into the
+// error bound. Times are 32-bit micros() and may wrap.
+///////////////////////////////////////////////////////////////
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+#define CLOCK_SYNC_WINDOW 8                 // recent samples; the best one gives the offset
+#define CLOCK_DRIFT_MIN_SPAN_US 30000000    // measure drift over at least 30 s...
+#define CLOCK_ANCHOR_MAX_SPAN_US 1200000000 // ...and re-anchor after 20 min, well before int32 wraps
+#define CLOCK_MAX_DRIFT_PPM 200             // a measurement beyond this is noise, not a crystal
+#define CLOCK_UNKNOWN_DRIFT_PPM 50          // two crystals' tolerance, until drift is measured
+#define CLOCK_STEP_US 50000                 // a sample this far off means the peer rebooted
+
+class ClockSync {
+public:
+    void reset();
+
+    // One exchange (see above). Returns false if the sample was rejected.
+    bool addSample(uint32_t localSendUs, uint32_t remoteReceiveUs, uint32_t remoteSendUs, uint32_t localReceiveUs);
+
+    bool synced() const { return count > 0; }
+    uint8_t samples() const { return count; }
+
+    // Our time <-> the peer's
+    uint32_t toRemote(uint32_t localUs) const;
+    uint32_t toLocal(uint32_t remoteUs) const;
+
+    // Bound on the error of toRemote(localUs): half the best round trip, plus
+    // what the drift can add since that sample
+    uint32_t errorUs(uint32_t localUs) const;
+
+    uint32_t roundTripUs() const { return best().roundTripUs; }
+    double driftPpm() const { return drift * 1e6; }
+    double driftErrorPpm() const { return hasDrift ? driftError * 1e6 : CLOCK_UNKNOWN_DRIFT_PPM; }
+    bool driftKnown() const { return hasDrift; }
+
+private:
+    struct Sample {
+        uint32_t localUs;       // midpoint of the exchange, our clock
+        uint32_t offsetUs;      // peer - local, modulo 2^32
+        uint32_t roundTripUs;
+    };
+
+    const Sample &best() const { return window[bestIndex]; }
+    void update();
+
+    Sample window[CLOCK_SYNC_WINDOW];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    uint8_t bestIndex = 0;
+    Sample anchor;
+    bool hasAnchor = false;
+    double drift = 0;           // offset change per local microsecond
+    double driftError = 0;      // bound on the error of `drift`
+    bool hasDrift = false;
+};
+
+#endif
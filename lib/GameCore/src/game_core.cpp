@@ -0,0 +1,131 @@
+#include "game_core.h"
+#include <stdio.h>
+
+// Start positions, matching the server and client sketches
+#define SERVER_START_X 10
+#define SERVER_START_Y 120
+#define CLIENT_START_X 300
+#define CLIENT_START_Y 120
+
+void gameReset(GameState &state, uint32_t seed) {
+    state.tick = 0;
+    state.rng.seed(seed);
+    state.server = { SERVER_START_X, SERVER_START_Y, 1 };
+    state.client = { CLIENT_START_X, CLIENT_START_Y, 1 };
+    state.serverPrevInput = 0;
+    state.clientPrevInput = 0;
+    state.over = false;
+}
+
+///////////////////////////////////////////////////////////////
+// Moves by up to `acceleration` pixels per axis, staying inside
+// (0, GAME_WIDTH) x (0, GAME_HEIGHT) like the per-pixel loops
+///////////////////////////////////////////////////////////////
+void moveDot(Dot &dot, uint8_t input) {
+    if (input & IN_X_POS) {
+        if (dot.x + dot.acceleration < GAME_WIDTH) dot.x += dot.acceleration;
+        else if (dot.x < GAME_WIDTH - 1) dot.x = GAME_WIDTH - 1;
+    } else if (input & IN_X_NEG) {
+        if (dot.x - dot.acceleration > 0) dot.x -= dot.acceleration;
+        else if (dot.x > 1) dot.x = 1;
+    }
+    if (input & IN_Y_POS) {
+        if (dot.y + dot.acceleration < GAME_HEIGHT) dot.y += dot.acceleration;
+        else if (dot.y < GAME_HEIGHT - 1) dot.y = GAME_HEIGHT - 1;
+    } else if (input & IN_Y_NEG) {
+        if (dot.y - dot.acceleration > 0) dot.y -= dot.acceleration;
+        else if (dot.y > 1) dot.y = 1;
+    }
+}
+
+void cycleAcceleration(Dot &dot) {
+    dot.acceleration = dot.acceleration == MAX_ACCELERATION ? 1 : dot.acceleration + 1;
+}
+
+///////////////////////////////////////////////////////////////
+// Same decision as checkDistance(): the truncated distance is
+// at most COLLISION_DISTANCE, i.e. d^2 < (COLLISION_DISTANCE+1)^2
+///////////////////////////////////////////////////////////////
+bool dotsCollide(int x1, int y1, int x2, int y2) {
+    long dx = x1 - x2;
+    long dy = y1 - y2;
+    return dx * dx + dy * dy < (long)(COLLISION_DISTANCE + 1) * (COLLISION_DISTANCE + 1);
+}
+
+void motionReset(Motion &motion, int x, int y) {
+    motion.x = (int32_t)x << MOTION_SHIFT;
+    motion.y = (int32_t)y << MOTION_SHIFT;
+    motion.vx = 0;
+    motion.vy = 0;
+}
+
+///////////////////////////////////////////////////////////////
+// One axis: velocity ramps towards the stick's deflection of
+// the dot's speed, position integrates it and is clamped to
+// (0, limit) once, the same bounds moveDot() keeps
+///////////////////////////////////////////////////////////////
+static void motionAxis(int32_t &position, int32_t &velocity, int amount, int32_t topSpeed,
+                       int32_t maxChange, uint32_t elapsedMs, int limit) {
+    int32_t target = amount * topSpeed / MOTION_FULL;
+    if (velocity < target)
+        velocity = velocity + maxChange < target ? velocity + maxChange : target;
+    else if (velocity > target)
+        velocity = velocity - maxChange > target ? velocity - maxChange : target;
+    position += velocity * (int32_t)elapsedMs;
+
+    const int32_t low = (int32_t)1 << MOTION_SHIFT;
+    const int32_t high = (int32_t)(limit - 1) << MOTION_SHIFT;
+    if (position < low) {
+        position = low;
+        velocity = 0;
+    } else if (position > high) {
+        position = high;
+        velocity = 0;
+    }
+}
+
+void motionStep(Motion &motion, uint8_t input, uint8_t speed, uint32_t elapsedMs) {
+    int xAmount = (input & IN_X_POS) ? MOTION_FULL : (input & IN_X_NEG) ? -MOTION_FULL : 0;
+    int yAmount = (input & IN_Y_POS) ? MOTION_FULL : (input & IN_Y_NEG) ? -MOTION_FULL : 0;
+    motionStep(motion, xAmount, yAmount, speed, elapsedMs);
+}
+
+void motionStep(Motion &motion, int xAmount, int yAmount, uint8_t speed, uint32_t elapsedMs) {
+    if (elapsedMs > MOTION_MAX_STEP_MS)
+        elapsedMs = MOTION_MAX_STEP_MS;
+    const int32_t topSpeed = ((int32_t)speed << MOTION_SHIFT) / MOTION_FRAME_MS;
+    const int32_t maxChange = ((int32_t)MAX_ACCELERATION << MOTION_SHIFT) / MOTION_FRAME_MS * (int32_t)elapsedMs /
+                              MOTION_RAMP_MS;
+    motionAxis(motion.x, motion.vx, xAmount, topSpeed, maxChange, elapsedMs, GAME_WIDTH);
+    motionAxis(motion.y, motion.vy, yAmount, topSpeed, maxChange, elapsedMs, GAME_HEIGHT);
+}
+
+static void stepDot(GameState &state, Dot &dot, uint8_t input, uint8_t prevInput) {
+    moveDot(dot, input);
+
+    // Buttons act on the press, not while held
+    uint8_t pressed = input & ~prevInput;
+    if (pressed & IN_SELECT)
+        cycleAcceleration(dot);
+    if (pressed & IN_START) {
+        dot.x = state.rng.next() % GAME_WIDTH;
+        dot.y = state.rng.next() % GAME_HEIGHT;
+    }
+}
+
+void gameStep(GameState &state, uint8_t serverInput, uint8_t clientInput) {
+    if (state.over)
+        return;
+    stepDot(state, state.server, serverInput, state.serverPrevInput);
+    stepDot(state, state.client, clientInput, state.clientPrevInput);
+    state.serverPrevInput = serverInput;
+    state.clientPrevInput = clientInput;
+    state.over = dotsCollide(state.server.x, state.server.y, state.client.x, state.client.y);
+    state.tick++;
+}
+
+void formatLasted(long milis, char *text, size_t size) {
+    unsigned long seconds = milis / 1000;
+    unsigned long miliseconds = milis % 60;
+    snprintf(text, size, "%02lu.%02lus", seconds, miliseconds);
+}
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////
+// Game rules shared by every sketch (and host tools)
+// Plain C++ with no Arduino dependencies
+///////////////////////////////////////////////////////////////
+#ifndef GAME_CORE_H
+#define GAME_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Playfield (the Core2 LCD) and rules
+#define GAME_WIDTH 320
+#define GAME_HEIGHT 240
+#define COLLISION_DISTANCE 30
+#define MAX_ACCELERATION 5
+
+// One input sample: joystick direction and gamepad buttons, one bit each
+enum InputBits : uint8_t {
+    IN_X_POS = 1 << 0,      // joystick right (x++)
+    IN_X_NEG = 1 << 1,      // joystick left (x--)
+    IN_Y_POS = 1 << 2,      // joystick down (y++)
+    IN_Y_NEG = 1 << 3,      // joystick up (y--)
+    IN_SELECT = 1 << 4,     // cycle acceleration
+    IN_START = 1 << 5,      // warp
+};
+
+// Small deterministic PRNG (xorshift32) so both devices warp identically
+struct GameRng {
+    uint32_t state;
+
+    void seed(uint32_t seed) { state = seed != 0 ? seed : 0x9E3779B9; }
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+struct Dot {
+    int16_t x;
+    int16_t y;
+    uint8_t acceleration;
+};
+
+// Free-running movement, for the sketches that aren't in lockstep: 16.16 fixed
+// point, scaled by the time since the last frame instead of once per frame
+#define MOTION_SHIFT 16
+#define MOTION_FRAME_MS 20          // speed N covers N pixels per 20 ms, like a lockstep tick
+#define MOTION_RAMP_MS 60           // rest to top speed, and back to rest on release
+#define MOTION_MAX_STEP_MS 100      // longer gaps (a warp or SELECT pause) don't teleport the dot
+#define MOTION_FULL 256             // full stick deflection, for proportional input
+
+struct Motion {
+    int32_t x, y;       // pixels << MOTION_SHIFT
+    int32_t vx, vy;     // pixels per ms << MOTION_SHIFT
+};
+
+// Both dots and everything needed to step them; identical inputs give identical states
+struct GameState {
+    uint32_t tick;
+    GameRng rng;
+    Dot server;
+    Dot client;
+    uint8_t serverPrevInput;
+    uint8_t clientPrevInput;
+    bool over;
+};
+
+void gameReset(GameState &state, uint32_t seed);
+void gameStep(GameState &state, uint8_t serverInput, uint8_t clientInput);
+void moveDot(Dot &dot, uint8_t input);
+void cycleAcceleration(Dot &dot);
+bool dotsCollide(int x1, int y1, int x2, int y2);
+void motionReset(Motion &motion, int x, int y);
+void motionStep(Motion &motion, uint8_t input, uint8_t speed, uint32_t elapsedMs);
+void motionStep(Motion &motion, int xAmount, int yAmount, uint8_t speed, uint32_t elapsedMs);
+inline int motionX(const Motion &motion) { return motion.x >> MOTION_SHIFT; }
+inline int motionY(const Motion &motion) { return motion.y >> MOTION_SHIFT; }
+
+// Game over time as "SS.mms" (what GameEngine's milis_to_seconds() draws)
+void formatLasted(long milis, char *text, size_t size);
+
+#endif
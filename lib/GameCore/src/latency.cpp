@@ -0,0 +1,82 @@
+#include "latency.h"
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = 0;
+    samples = 0;
+    sum = 0;
+    lowest = 0;
+    highest = 0;
+}
+
+void LatencyHistogram::add(int32_t us) {
+    int bucket = us < 0 ? 0 : us / LATENCY_BUCKET_US;
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    buckets[bucket]++;
+    if (samples == 0 || us < lowest)
+        lowest = us;
+    if (samples == 0 || us > highest)
+        highest = us;
+    sum += us;
+    samples++;
+}
+
+int32_t LatencyHistogram::percentileUs(float p) const {
+    if (samples == 0)
+        return 0;
+    uint32_t rank = (uint32_t)(p * (samples - 1)) + 1;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            int32_t edge = (i + 1) * LATENCY_BUCKET_US;
+            return edge < highest ? edge : highest;
+        }
+    }
+    return highest;
+}
+
+void LatencyMatcher::reset() {
+    count = 0;
+    waiting = false;
+}
+
+void LatencyMatcher::expect(int16_t x, int16_t y, uint32_t sampleUs) {
+    stampX = x;
+    stampY = y;
+    stampUs = sampleUs;
+    waiting = true;
+}
+
+void LatencyMatcher::drawn(int16_t x, int16_t y, uint32_t drawnUs) {
+    nowUs = drawnUs;
+    if (count > 0) {
+        const Drawn &newest = history[(count - 1) % LATENCY_DRAWN_HISTORY];
+        if (newest.x == x && newest.y == y)
+            return;
+    }
+    history[count % LATENCY_DRAWN_HISTORY] = { x, y, drawnUs };
+    count++;
+}
+
+bool LatencyMatcher::take(int32_t &latencyUs) {
+    if (!waiting)
+        return false;
+    // Oldest first: the first time the position was drawn after the sample
+    // (give or take a bucket of clock sync error; anything earlier is an
+    // older visit to the same spot)
+    uint32_t kept = count < LATENCY_DRAWN_HISTORY ? count : LATENCY_DRAWN_HISTORY;
+    for (uint32_t i = count - kept; i < count; i++) {
+        const Drawn &entry = history[i % LATENCY_DRAWN_HISTORY];
+        int32_t sinceSampleUs = (int32_t)(entry.us - stampUs);
+        if (entry.x == stampX && entry.y == stampY && sinceSampleUs >= -LATENCY_BUCKET_US) {
+            waiting = false;
+            latencyUs = sinceSampleUs;
+            return true;
+        }
+    }
+    if ((int32_t)(nowUs - stampUs) > LATENCY_BUCKETS * LATENCY_BUCKET_US)
+        waiting = false;
+    return false;
+}
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////
+// Latency histogram for the input-to-photon measurement: fixed
+// buckets so adding a sample is cheap enough for the frame loop,
+// percentiles read back from the buckets. Samples are signed,
+// since a latency measured across two clocks can come out
+// slightly negative within the sync error.
+///////////////////////////////////////////////////////////////
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_BUCKET_US 2000      // 2 ms per bucket...
+#define LATENCY_BUCKETS 64          // ...up to 128 ms; anything later goes in the last one
+#define LATENCY_BAR_WIDTH 40        // '#'s for the fullest bucket when printed
+#define LATENCY_DRAWN_HISTORY 32    // peer positions remembered with the time they were first drawn
+
+class LatencyHistogram {
+public:
+    void reset();
+    void add(int32_t us);
+
+    uint32_t count() const { return samples; }
+    int32_t minUs() const { return lowest; }
+    int32_t maxUs() const { return highest; }
+    int32_t meanUs() const { return samples ? (int32_t)(sum / samples) : 0; }
+
+    // Upper edge of the bucket holding the p-th fraction of the samples
+    // (the exact maximum once that is the overflow bucket)
+    int32_t percentileUs(float p) const;
+
+    // Summary line and one bar per used bucket, through anything with a
+    // printf (Serial on the devices)
+    template <typename Out>
+    void print(Out &out, const char *name) const {
+        if (samples == 0) {
+            out.printf("%s: no samples\n", name);
+            return;
+        }
+        out.printf("%s: n=%lu min=%.1f mean=%.1f p50=%.1f p90=%.1f p99=%.1f max=%.1f ms\n", name,
+                   (unsigned long)samples, lowest / 1000.0, meanUs() / 1000.0, percentileUs(0.5f) / 1000.0,
+                   percentileUs(0.9f) / 1000.0, percentileUs(0.99f) / 1000.0, highest / 1000.0);
+        uint32_t fullest = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+            if (buckets[i] > fullest)
+                fullest = buckets[i];
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            if (buckets[i] == 0)
+                continue;
+            char bar[LATENCY_BAR_WIDTH + 1];
+            int width = (buckets[i] * LATENCY_BAR_WIDTH + fullest - 1) / fullest;
+            for (int j = 0; j < width; j++)
+                bar[j] = '#';
+            bar[width] = '\0';
+            out.printf("  %3d-%-3d%s ms %6lu %s\n", i * LATENCY_BUCKET_US / 1000,
+                       (i + 1) * LATENCY_BUCKET_US / 1000, i == LATENCY_BUCKETS - 1 ? "+" : " ",
+                       (unsigned long)buckets[i], bar);
+        }
+    }
+
+private:
+    uint32_t buckets[LATENCY_BUCKETS] = {};
+    uint32_t samples = 0;
+    int64_t sum = 0;
+    int32_t lowest = 0;
+    int32_t highest = 0;
+};
+
+// Matches a peer's stamp to the frame that first drew the position it
+// describes. The stamp travels after the position, so timing the frame that
+// follows its arrival would add the stamp's own trip to every sample; instead
+// each new peer position is remembered with the time it was first drawn, and
+// the stamp is looked up there (or waits for that frame if it came first).
+// All times are on the stamps' timebase.
+class LatencyMatcher {
+public:
+    void reset();
+
+    // A stamp arrived; replaces one still waiting for its frame
+    void expect(int16_t x, int16_t y, uint32_t sampleUs);
+
+    // After every frame: where the peer's dot is drawn now
+    void drawn(int16_t x, int16_t y, uint32_t drawnUs);
+
+    // The latency of the waiting stamp once its position has been drawn;
+    // a stamp nothing drew within the histogram's range is dropped
+    bool take(int32_t &latencyUs);
+
+private:
+    struct Drawn {
+        int16_t x, y;
+        uint32_t us;
+    };
+    Drawn history[LATENCY_DRAWN_HISTORY];
+    uint32_t count = 0;         // entries ever added; the newest is history[(count - 1) % size]
+    bool waiting = false;
+    int16_t stampX = 0, stampY = 0;
+    uint32_t stampUs = 0;
+    uint32_t nowUs = 0;         // the last drawn() time
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "lockstep.h"
+
+#define SLOT(tick) ((tick) & (LOCKSTEP_BUFFER - 1))
+
+void LockstepSession::reset(uint32_t seed) {
+    gameReset(state, seed);
+    session = (uint8_t)seed;
+    resume();
+}
+
+void LockstepSession::restore(uint32_t seed, const GameState &restored) {
+    state = restored;
+    session = (uint8_t)seed;
+    resume();
+}
+
+void LockstepSession::resume() {
+    // Held buttons are not part of the snapshot, so both sides forget them
+    state.serverPrevInput = 0;
+    state.clientPrevInput = 0;
+    waitingForPeer = isServer;
+    for (uint32_t t = state.tick; t < state.tick + LOCKSTEP_INPUT_DELAY; t++) {
+        localInputs[SLOT(t)] = 0;
+        remoteInputs[SLOT(t)] = 0;
+    }
+    nextLocalTick = state.tick + LOCKSTEP_INPUT_DELAY;
+    nextRemoteTick = state.tick + LOCKSTEP_INPUT_DELAY;
+}
+
+void LockstepSession::addLocalInput(uint8_t input, LockstepPacket &packet) {
+    if (!waitingForPeer && nextLocalTick <= state.tick + LOCKSTEP_INPUT_DELAY)
+        localInputs[SLOT(nextLocalTick++)] = input;
+
+    uint32_t newest = nextLocalTick - 1;
+    packet.session = session;
+    packet.tick = (uint16_t)newest;
+    for (int i = 0; i < LOCKSTEP_REDUNDANCY; i++)
+        packet.inputs[i] = localInputs[SLOT(newest - i)];
+}
+
+int LockstepSession::addRemoteInput(const LockstepPacket &packet) {
+    if (packet.session != session)
+        return 0;
+    waitingForPeer = false;
+
+    // Recover the full tick from its low 16 bits relative to what we expect next
+    int16_t delta = (int16_t)(packet.tick - (uint16_t)nextRemoteTick);
+    if (delta < 0 || delta >= LOCKSTEP_REDUNDANCY)
+        return 0;   // stale (already have it) or too far ahead to fill the gap
+    uint32_t newest = nextRemoteTick + delta;
+    for (uint32_t t = nextRemoteTick; t <= newest; t++)
+        remoteInputs[SLOT(t)] = packet.inputs[newest - t];
+    nextRemoteTick = newest + 1;
+    return delta + 1;
+}
+
+int LockstepSession::advance() {
+    int steps = 0;
+    while (!waitingForPeer && !state.over && state.tick < nextLocalTick && state.tick < nextRemoteTick) {
+        uint8_t local = localInputs[SLOT(state.tick)];
+        uint8_t remote = remoteInputs[SLOT(state.tick)];
+        gameStep(state, isServer ? local : remote, isServer ? remote : local);
+        steps++;
+    }
+    return steps;
+}
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////
+// Deterministic lockstep: both devices run gameStep() on the
+// same seed and the same per-tick inputs, exchanging only the
+// inputs. A tick is simulated once both sides' inputs for it
+// have arrived.
+///////////////////////////////////////////////////////////////
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include "game_core.h"
+
+#define LOCKSTEP_TICK_MS 20         // 50 ticks per second
+#define LOCKSTEP_INPUT_DELAY 3      // local input is scheduled this many ticks ahead
+#define LOCKSTEP_REDUNDANCY 4       // each packet repeats this many recent inputs
+#define LOCKSTEP_BUFFER 16          // power of two, > LOCKSTEP_INPUT_DELAY + LOCKSTEP_REDUNDANCY
+
+// Wire format: the input for `tick` and the ones before it, newest first,
+// so a dropped packet is covered by the next one
+struct __attribute__((packed)) LockstepPacket {
+    uint8_t session;        // low byte of the match seed; drops packets from an old match
+    uint16_t tick;
+    uint8_t inputs[LOCKSTEP_REDUNDANCY];
+};
+
+class LockstepSession {
+public:
+    explicit LockstepSession(bool isServer) : isServer(isServer) {}
+
+    // Starts a new match from tick 0
+    void reset(uint32_t seed);
+    // Continues the match `seed` from a state taken from the server's snapshot
+    void restore(uint32_t seed, const GameState &restored);
+    // Restarts the input exchange from the current state (after a reconnect or
+    // a restore); the first INPUT_DELAY ticks are neutral on both sides. The
+    // server then holds the simulation until the client's first packet arrives,
+    // so it cannot run ahead of a snapshot the client has not adopted yet.
+    void resume();
+
+    // Schedules a local input sample (dropped while we are already INPUT_DELAY
+    // ticks ahead of the simulation, waiting on the peer) and fills in the packet
+    // to send this tick. Send it even when nothing new was scheduled: the repeat
+    // is what recovers a lost packet while both sides are waiting.
+    void addLocalInput(uint8_t input, LockstepPacket &packet);
+
+    // Returns how many of the packet's inputs were new (inputs[n - 1] .. inputs[0],
+    // oldest first); the rest repeat ones already received
+    int addRemoteInput(const LockstepPacket &packet);
+
+    // Runs every tick both inputs are available for; returns the number stepped
+    int advance();
+
+    GameState state;
+
+private:
+    bool isServer;
+    bool waitingForPeer;
+    uint8_t session;
+    uint8_t localInputs[LOCKSTEP_BUFFER];
+    uint8_t remoteInputs[LOCKSTEP_BUFFER];
+    uint32_t nextLocalTick;
+    uint32_t nextRemoteTick;
+};
+
+#endif
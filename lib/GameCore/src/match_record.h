@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////
+// Match recording file format (written by lib/MatchRecorder,
+// read by the host tools). Little-endian, append-only:
+// one RecordFileHeader, then records of RecordHeader + payload.
+///////////////////////////////////////////////////////////////
+#ifndef MATCH_RECORD_H
+#define MATCH_RECORD_H
+
+#include <stdint.h>
+
+#define RECORD_MAGIC 0x4345524D     // "MREC"
+#define RECORD_VERSION 2     // 2: RecordFileHeader.mode (a reserved, zero byte in 1)
+#define RECORD_VERSION_NO_MODE 1
+
+enum RecordRole : uint8_t {
+    ROLE_SERVER = 0,
+    ROLE_CLIENT = 1,
+};
+
+// How the recording device played: tells a replay what its inputs drive
+enum RecordMode : uint8_t {
+    MODE_POSITIONS = 0,     // each side moves its own dot and sends positions
+    MODE_LOCKSTEP = 1,      // LOCKSTEP_MODE
+    MODE_AUTHORITATIVE = 2, // AUTHORITATIVE_MODE: a server file has one remote then one local input per tick
+};
+
+struct __attribute__((packed)) RecordFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t role;           // RecordRole of the device that wrote the file
+    uint8_t mode;           // RecordMode (version 2 on; unknown in version 1)
+    uint32_t bootMs;        // millis() when recording started
+};
+
+enum RecordType : uint8_t {
+    REC_INPUT = 1,          // RecordInput
+    REC_POSITION = 2,       // RecordPosition
+    REC_BLE = 3,            // RecordBle
+    REC_MATCH = 4,          // RecordMatch
+};
+
+// `length` is the payload size, so readers can skip types they do not know
+struct __attribute__((packed)) RecordHeader {
+    uint8_t type;
+    uint8_t length;
+    uint32_t timeUs;        // micros() when the record was appended (wraps after ~71 min; records
+                            // from the BLE task and loop() may be a few us out of order)
+};
+
+enum RecordSide : uint8_t {
+    SIDE_LOCAL = 0,
+    SIDE_REMOTE = 1,
+};
+
+// One input sample (InputBits) from this device or received from the peer
+struct __attribute__((packed)) RecordInput {
+    uint8_t side;           // RecordSide
+    uint8_t input;
+};
+
+// Dot positions as this device knows them
+struct __attribute__((packed)) RecordPosition {
+    int16_t xServer;
+    int16_t yServer;
+    int16_t xClient;
+    int16_t yClient;
+};
+
+enum RecordBleEvent : uint8_t {
+    BLE_CONNECTED = 1,
+    BLE_DISCONNECTED = 2,
+    BLE_SUBSCRIBED = 3,
+    BLE_TX = 4,             // we wrote / notified `value` bytes
+    BLE_RX = 5,             // we received `value` bytes
+};
+
+struct __attribute__((packed)) RecordBle {
+    uint8_t event;          // RecordBleEvent
+    uint16_t handle;        // attribute handle, 0 if not applicable
+    uint16_t value;         // event specific (payload length for TX/RX)
+};
+
+// Match boundaries: a new session, or the screen changing (game over)
+struct __attribute__((packed)) RecordMatch {
+    uint32_t sessionId;
+    uint8_t screen;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "telemetry_stream.h"
+#include <string.h>
+
+uint16_t telemetryCrc(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+///////////////////////////////////////////////////////////////
+// COBS: each zero becomes the distance to the next one, with a
+// leading code byte for the first. Frames are far shorter than
+// the 254-byte runs that would need an extra code byte.
+///////////////////////////////////////////////////////////////
+size_t telemetryEncode(uint8_t type, uint8_t seq, const void *payload, uint8_t length, uint8_t *out) {
+    if (length > TELEMETRY_MAX_PAYLOAD)
+        return 0;
+    uint8_t raw[TELEMETRY_MAX_RAW];
+    raw[0] = type;
+    raw[1] = seq;
+    memcpy(raw + 2, payload, length);
+    uint16_t crc = telemetryCrc(raw, length + 2);
+    raw[length + 2] = crc & 0xFF;
+    raw[length + 3] = crc >> 8;
+
+    size_t n = 0;
+    out[n++] = 0;
+    size_t code = n++;
+    uint8_t run = 1;
+    for (size_t i = 0; i < (size_t)length + 4; i++) {
+        if (raw[i] == 0) {
+            out[code] = run;
+            code = n++;
+            run = 1;
+        } else {
+            out[n++] = raw[i];
+            run++;
+        }
+    }
+    out[code] = run;
+    out[n++] = 0;
+    return n;
+}
+
+TelemetryDecoder::Result TelemetryDecoder::feed(uint8_t byte) {
+    if (complete) {
+        count = 0;
+        complete = false;
+    }
+    if (byte != 0) {
+        if (count < TELEMETRY_MAX_CHUNK)
+            bytes[count] = byte;
+        count++;
+        return NONE;
+    }
+    // Two delimiters in a row (between frames) end an empty chunk
+    if (count == 0)
+        return NONE;
+    complete = true;
+    return decode() ? FRAME : TEXT;
+}
+
+bool TelemetryDecoder::decode() {
+    if (count > TELEMETRY_MAX_RAW + 1)
+        return false;
+    size_t i = 0;
+    rawLength = 0;
+    while (i < count) {
+        uint8_t code = bytes[i++];
+        for (uint8_t j = 1; j < code; j++) {
+            if (i >= count)
+                return false;
+            raw[rawLength++] = bytes[i++];
+        }
+        if (code < 0xFF && i < count)
+            raw[rawLength++] = 0;
+    }
+    if (rawLength < 4)
+        return false;
+    uint16_t crc = raw[rawLength - 2] | (uint16_t)raw[rawLength - 1] << 8;
+    return crc == telemetryCrc(raw, rawLength - 2);
+}
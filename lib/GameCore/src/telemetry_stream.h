@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////
+// Binary telemetry on the USB serial port (written by
+// lib/Telemetry, decoded by tools/telemetry). Little-endian.
+//
+// Each frame is [type][seq][payload][CRC-16 of the three],
+// COBS-encoded so it contains no zero byte, between two zero
+// delimiters. The decoder resyncs on any zero, a lost or
+// mangled byte costs one frame (the CRC catches it), and a
+// gap in `seq` tells the host how many frames it missed. Text
+// printed to the same port has no zero bytes either, so it
+// arrives as a chunk that does not decode and can be shown
+// as a log line.
+///////////////////////////////////////////////////////////////
+#ifndef TELEMETRY_STREAM_H
+#define TELEMETRY_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_MAX_PAYLOAD 32
+#define TELEMETRY_MAX_CHUNK 128     // longest chunk the decoder keeps (log lines included)
+
+// Unencoded type + seq + payload + CRC, and on the wire: COBS overhead + delimiters
+#define TELEMETRY_MAX_RAW (2 + TELEMETRY_MAX_PAYLOAD + 2)
+#define TELEMETRY_MAX_ENCODED (TELEMETRY_MAX_RAW + 1 + 2)
+
+enum TelemetryType : uint8_t {
+    TLM_HELLO = 1,          // TelemetryHello
+    TLM_FRAME = 2,          // TelemetryFrame
+    TLM_STATS = 3,          // TelemetryStats
+};
+
+// Who is talking; sent with every stats record so a decoder can attach any time
+struct __attribute__((packed)) TelemetryHello {
+    uint16_t version;       // TELEMETRY_VERSION
+    uint8_t role;           // RecordRole (match_record.h)
+    uint8_t mode;           // RecordMode
+};
+
+// One loop() iteration during a match
+struct __attribute__((packed)) TelemetryFrame {
+    uint32_t timeUs;        // micros() at the start of the iteration (wraps after ~71 min)
+    uint16_t frameUs;       // since the previous iteration started, 0xFFFF if longer
+    uint16_t networkUs;     // BLE work loop() does around the game (connection, writes, clock, notifies)
+    uint16_t gameUs;        // input, simulation and render
+    uint16_t renderUs;      // the part of gameUs spent drawing, or handing off to the render task
+    uint8_t screen;         // the sketch's Screen
+};
+
+// Once a second
+struct __attribute__((packed)) TelemetryStats {
+    uint32_t timeUs;
+    uint32_t rttUs;         // best clock sync round trip, 0 if this device does not measure one
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;   // low-water mark since boot
+    uint32_t largestBlock;  // largest allocatable block (fragmentation)
+    uint16_t stackFree;     // loop() task stack high-water mark, bytes
+    uint32_t dropped;       // frames not sent because the serial port was busy
+};
+
+// CRC-16/CCITT-FALSE
+uint16_t telemetryCrc(const uint8_t *data, size_t length);
+
+// Frames `payload` into `out` (TELEMETRY_MAX_ENCODED bytes) and returns the
+// encoded length, 0 if the payload is too long
+size_t telemetryEncode(uint8_t type, uint8_t seq, const void *payload, uint8_t length, uint8_t *out);
+
+class TelemetryDecoder {
+public:
+    enum Result {
+        NONE,               // mid-chunk
+        FRAME,              // type(), seq(), payload(), length() are valid
+        TEXT,               // a chunk that is not a frame: chunk(), chunkLength()
+    };
+
+    Result feed(uint8_t byte);
+
+    uint8_t type() const { return raw[0]; }
+    uint8_t seq() const { return raw[1]; }
+    const uint8_t *payload() const { return raw + 2; }
+    uint8_t length() const { return rawLength - 4; }
+
+    // The undecoded chunk (truncated at TELEMETRY_MAX_CHUNK) after TEXT
+    const uint8_t *chunk() const { return bytes; }
+    size_t chunkLength() const { return count < TELEMETRY_MAX_CHUNK ? count : TELEMETRY_MAX_CHUNK; }
+
+private:
+    bool decode();
+
+    uint8_t bytes[TELEMETRY_MAX_CHUNK];
+    size_t count = 0;
+    bool complete = false;      // the last byte ended a chunk; the next one starts another
+    uint8_t raw[TELEMETRY_MAX_RAW];
+    size_t rawLength = 0;
+};
+
+#endif
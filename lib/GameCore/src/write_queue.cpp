@@ -0,0 +1,35 @@
+#include "write_queue.h"
+#include <string.h>
+
+bool WriteQueue::push(uint16_t handle, const uint8_t *data, uint8_t length) {
+    if (length > WRITE_QUEUE_MAX_VALUE) {
+        droppedValues++;
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (entries[i].handle == handle) {
+            remove(i);
+            replacedValues++;
+            break;
+        }
+    }
+    if (count == WRITE_QUEUE_SLOTS) {
+        droppedValues++;
+        return false;
+    }
+    Entry &entry = entries[count++];
+    entry.handle = handle;
+    entry.length = length;
+    memcpy(entry.value, data, length);
+    return true;
+}
+
+void WriteQueue::pop() {
+    if (count > 0)
+        remove(0);
+}
+
+void WriteQueue::remove(uint8_t index) {
+    memmove(&entries[index], &entries[index + 1], (count - index - 1) * sizeof(Entry));
+    count--;
+}
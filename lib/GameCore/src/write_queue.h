@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////
+// Outgoing GATT writes waiting for room in the controller.
+// Bounded and latest-wins: a new value for a handle that still
+// has one queued replaces it (the values we write are state,
+// so only the newest matters) and moves to the back, which
+// keeps the latest values in the order they were written (a
+// position before the latency stamp that refers to it). A new
+// handle with every slot taken is dropped.
+///////////////////////////////////////////////////////////////
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include <stdint.h>
+
+#define WRITE_QUEUE_SLOTS 8         // one per handle written, with room to spare
+#define WRITE_QUEUE_MAX_VALUE 20    // largest value queued; the sketch asserts its writes fit
+
+class WriteQueue {
+public:
+    struct Entry {
+        uint16_t handle;
+        uint8_t length;
+        uint8_t value[WRITE_QUEUE_MAX_VALUE];
+    };
+
+    // False if the value was dropped (queue full, or longer than a write can carry)
+    bool push(uint16_t handle, const uint8_t *data, uint8_t length);
+
+    bool empty() const { return count == 0; }
+    uint8_t size() const { return count; }
+    const Entry &front() const { return entries[0]; }
+    void pop();
+    void clear() { count = 0; }
+
+    // Values overwritten before they were sent / not queued at all
+    uint32_t replaced() const { return replacedValues; }
+    uint32_t dropped() const { return droppedValues; }
+
+private:
+    void remove(uint8_t index);
+
+    Entry entries[WRITE_QUEUE_SLOTS];
+    uint8_t count = 0;
+    uint32_t replacedValues = 0;
+    uint32_t droppedValues = 0;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#include "dma_strips.h"
+#include <esp_heap_caps.h>
+
+bool DmaStrips::begin(int width, int height) {
+    size_t size = width * DMA_STRIP_LINES * sizeof(uint16_t);
+    uint16_t *first = (uint16_t *)heap_caps_malloc(size, MALLOC_CAP_DMA);
+    uint16_t *second = (uint16_t *)heap_caps_malloc(size, MALLOC_CAP_DMA);
+    if (first == nullptr || second == nullptr || !M5.Lcd.initDMA()) {
+        heap_caps_free(first);
+        heap_caps_free(second);
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    buffers[0] = first;
+    buffers[1] = second;
+    return true;
+}
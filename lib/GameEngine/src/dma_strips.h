@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////
+// Pipelined full-screen push for the render task. The frame is
+// encoded a strip at a time into one of two DMA-capable buffers
+// and each strip goes out as an asynchronous DMA transfer, so
+// encoding strip k+1 overlaps sending strip k, and the render
+// task sleeps through the transfers instead of spinning on the
+// SPI bus, leaving core 1 to the game loop. Two whole frames
+// would not fit in DMA-capable RAM, hence strips.
+//
+// Fence: a buffer is only rewritten once the transfer that read
+// it has completed. pushImageDMA() waits for the transfer before
+// it to finish before queuing its own, so when strip k+1 is
+// encoded only strip k (the other buffer) can be in flight;
+// push() waits for the last strip before it returns.
+//
+// The LCD shares its SPI bus with the SD card, which must not be
+// used while this holds the bus.
+///////////////////////////////////////////////////////////////
+#ifndef DMA_STRIPS_H
+#define DMA_STRIPS_H
+
+#include <M5Core2.h>
+
+#define DMA_STRIP_LINES 16          // 320 x 16 pixels, 10 KB per buffer
+
+class DmaStrips {
+public:
+    // Allocates the buffers and sets up the LCD's DMA; false if either fails
+    bool begin(int width, int height);
+    bool ready() const { return buffers[1] != nullptr; }
+
+    // Sends a whole frame; encode(buffer, y, lines) fills `lines` rows starting
+    // at row `y`, in the LCD's byte order (see swapped())
+    template <typename Encode>
+    void push(Encode encode) {
+        M5.Lcd.startWrite();
+        for (int y = 0, strip = 0; y < height; y += DMA_STRIP_LINES, strip++) {
+            int lines = height - y < DMA_STRIP_LINES ? height - y : DMA_STRIP_LINES;
+            uint16_t *buffer = buffers[strip & 1];
+            encode(buffer, y, lines);
+            M5.Lcd.pushImageDMA(0, y, width, lines, buffer);
+        }
+        M5.Lcd.dmaWait();
+        M5.Lcd.endWrite();
+    }
+
+    // RGB565 as the LCD takes it from memory (big-endian)
+    static uint16_t swapped(uint16_t color) { return (color << 8) | (color >> 8); }
+
+private:
+    uint16_t *buffers[2] = { nullptr, nullptr };
+    int width = 0;
+    int height = 0;
+};
+
+#endif
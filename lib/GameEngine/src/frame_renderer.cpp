@@ -0,0 +1,42 @@
+#include "frame_renderer.h"
+
+bool FrameRenderer::begin(DrawFunction draw, void *context, UBaseType_t priority, BaseType_t core) {
+    this->draw = draw;
+    this->context = context;
+    drawing = xSemaphoreCreateMutex();
+    QueueHandle_t frames = xQueueCreate(1, sizeof(DotFrame));
+    if (drawing == nullptr || frames == nullptr)
+        return false;
+    queue = frames;
+    return xTaskCreatePinnedToCore(renderTask, "render", 4096, this, priority, NULL, core) == pdPASS;
+}
+
+void FrameRenderer::submit(const DotFrame &frame) {
+    if (uxQueueMessagesWaiting(queue) > 0)
+        droppedFrames++;
+    xQueueOverwrite(queue, &frame);
+}
+
+void FrameRenderer::flush() {
+    if (!running())
+        return;
+    xSemaphoreTake(drawing, portMAX_DELAY);
+    xQueueReset(queue);
+    xSemaphoreGive(drawing);
+}
+
+///////////////////////////////////////////////////////////////
+// Waits for a frame without taking it, so a flush() between the
+// wait and the draw empties the queue and nothing is drawn
+///////////////////////////////////////////////////////////////
+void FrameRenderer::renderTask(void *parameter) {
+    FrameRenderer *renderer = (FrameRenderer *)parameter;
+    DotFrame frame;
+    for (;;) {
+        xQueuePeek(renderer->queue, &frame, portMAX_DELAY);
+        xSemaphoreTake(renderer->drawing, portMAX_DELAY);
+        if (xQueueReceive(renderer->queue, &frame, 0) == pdTRUE)
+            renderer->draw(frame, renderer->context);
+        xSemaphoreGive(renderer->drawing);
+    }
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////
+// Optional render task: the game hands each frame over through
+// a one-deep queue and carries on, and the task draws the most
+// recent one. A frame the task had no time for is replaced, not
+// queued behind, so the screen never lags the game.
+//
+// Anything else that draws on the LCD must flush() first, or a
+// frame still in flight could land on top of it.
+///////////////////////////////////////////////////////////////
+#ifndef FRAME_RENDERER_H
+#define FRAME_RENDERER_H
+
+#include <Arduino.h>
+
+// Everything a game frame shows
+struct DotFrame {
+    int16_t localX;
+    int16_t localY;
+    int16_t otherX;
+    int16_t otherY;
+};
+
+class FrameRenderer {
+public:
+    typedef void (*DrawFunction)(const DotFrame &frame, void *context);
+
+    // Starts the task on `core`, calling draw(frame, context) for each frame;
+    // until then running() is false
+    bool begin(DrawFunction draw, void *context, UBaseType_t priority, BaseType_t core);
+    bool running() const { return queue != nullptr; }
+
+    void submit(const DotFrame &frame);
+
+    // Drops the frame not drawn yet and waits for the one being drawn
+    void flush();
+
+    // Frames replaced before they were drawn
+    uint32_t dropped() const { return droppedFrames; }
+
+private:
+    static void renderTask(void *parameter);
+
+    DrawFunction draw = nullptr;
+    void *context = nullptr;
+    QueueHandle_t queue = nullptr;
+    SemaphoreHandle_t drawing = nullptr;
+    volatile uint32_t droppedFrames = 0;
+};
+
+#endif
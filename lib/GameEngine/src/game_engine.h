@@ -0,0 +1,313 @@
+///////////////////////////////////////////////////////////////
+// The dot game as every sketch plays it: read the gamepad, move
+// the dot(s), cycle acceleration, warp, check the distance and
+// draw the game over screen. Templated on the role so what
+// differs between targets (which buttons do what, what happens
+// when our dot moves) is decided at compile time.
+//
+// The engine works on the sketch's own position variables, so
+// the BLE code that reads and writes them is unchanged. Dots
+// move with GameCore's fixed-point motion, scaled by the time
+// since the last frame; sub-pixel position and velocity are
+// kept here and dropped whenever the sketch moves a dot itself
+// (snapshot, rematch).
+//
+// Frames are drawn inline by default; with startRenderTask()
+// they go to a FrameRenderer instead (optionally pushed with
+// DMA, overlapping the transfer with the next frame's
+// simulation), and the sketch must call flushRender() before
+// drawing anything of its own. hide() keeps the game running
+// without drawing it, while the sketch shows something else.
+///////////////////////////////////////////////////////////////
+#ifndef GAME_ENGINE_H
+#define GAME_ENGINE_H
+
+#include <M5Core2.h>
+#include <Adafruit_seesaw.h>
+#include <game_core.h>
+#include "joystick.h"
+#include "frame_renderer.h"
+#include "dma_strips.h"
+#include "status_screen.h"
+#include "task_layout.h"
+
+// Gamepad QT buttons
+#define GAMEPAD_X         6
+#define GAMEPAD_Y         2
+#define GAMEPAD_A         5
+#define GAMEPAD_B         1
+#define GAMEPAD_SELECT    0
+#define GAMEPAD_START    16
+
+///////////////////////////////////////////////////////////////
+// Roles. A sketch derives from one and hides the hooks it needs
+// (static functions, so the calls are resolved and inlined at
+// compile time); the defaults do nothing.
+///////////////////////////////////////////////////////////////
+
+// One dot on the joystick, the other one arrives over BLE
+struct NetworkRole {
+    static const bool twoLocalPlayers = false;
+    static const uint32_t buttonMask = (1UL << GAMEPAD_START) | (1UL << GAMEPAD_SELECT);
+    static const uint16_t localColor = TFT_RED;
+    static const uint16_t otherColor = TFT_BLUE;
+    static const unsigned long selectPauseMs = 500;
+    static const unsigned long startPauseMs = 500;
+
+    // Our dot moved (called at most once per frame) / was warped
+    static void moved(int x, int y) {}
+    static void warped(int x, int y) {}
+
+    // The input (InputBits) play() acted on this frame, every frame
+    static void sampled(uint8_t input) {}
+};
+
+struct ServerRole : NetworkRole {
+    static const unsigned long startPauseMs = 1000;
+};
+
+struct ClientRole : NetworkRole {};
+
+// Both dots on one gamepad: joystick + START for the first, A/B/X/Y + SELECT for the second
+struct LocalRole : NetworkRole {
+    static const bool twoLocalPlayers = true;
+    static const uint32_t buttonMask = (1UL << GAMEPAD_X) | (1UL << GAMEPAD_Y) | (1UL << GAMEPAD_START) |
+                                       (1UL << GAMEPAD_A) | (1UL << GAMEPAD_B) | (1UL << GAMEPAD_SELECT);
+    static const uint16_t localColor = TFT_WHITE;
+    static const uint16_t otherColor = TFT_WHITE;
+};
+
+///////////////////////////////////////////////////////////////
+// Game over time as "SS.mms" (GameCore's formatLasted())
+///////////////////////////////////////////////////////////////
+inline String milis_to_seconds(long milis) {
+    char text[24];
+    formatLasted(milis, text, sizeof(text));
+    return String(text);
+}
+
+template <typename Role>
+class GameEngine {
+public:
+    // `local` is the dot on the joystick; `other` is the peer's dot, or the
+    // second local player's (who then needs `otherAcceleration`)
+    GameEngine(Adafruit_seesaw &gamePad, int &localX, int &localY, int &localAcceleration,
+               int &otherX, int &otherY, int *otherAcceleration = nullptr)
+        : gamePad(gamePad), localX(localX), localY(localY), localAcceleration(localAcceleration),
+          otherX(otherX), otherY(otherY),
+          otherAcceleration(otherAcceleration != nullptr ? *otherAcceleration : unusedAcceleration) {}
+
+    // One frame of play: read the gamepad, move, draw
+    void play() {
+        unsigned long now = millis();
+        uint32_t elapsedMs = now - lastFrameMs;
+        lastFrameMs = now;
+
+        stick.read(gamePad);
+        int oldX = localX, oldY = localY;
+        move(localMotion, localX, localY, localAcceleration, stick.x(), stick.y(), elapsedMs);
+        if (localX != oldX || localY != oldY)
+            Role::moved(localX, localY);
+
+        // Role::twoLocalPlayers is a compile-time constant; only one branch is emitted
+        uint32_t buttons = gamePad.digitalReadBulk(Role::buttonMask);
+        if (Role::twoLocalPlayers) {
+            int otherXAmount = pressed(buttons, GAMEPAD_A) ? MOTION_FULL : pressed(buttons, GAMEPAD_Y) ? -MOTION_FULL : 0;
+            int otherYAmount = pressed(buttons, GAMEPAD_B) ? MOTION_FULL : pressed(buttons, GAMEPAD_X) ? -MOTION_FULL : 0;
+            move(otherMotion, otherX, otherY, otherAcceleration, otherXAmount, otherYAmount, elapsedMs);
+
+            if (pressed(buttons, GAMEPAD_SELECT)) {
+                cycle(otherAcceleration);
+                Serial.print("Button Accel: "); Serial.print(otherAcceleration);
+                delay(Role::selectPauseMs);
+            }
+            if (pressed(buttons, GAMEPAD_START)) {
+                cycle(localAcceleration);
+                Serial.print("Joy Accel: "); Serial.print(localAcceleration);
+                delay(Role::startPauseMs);
+            }
+        } else {
+            uint8_t input = stick.direction();
+            if (pressed(buttons, GAMEPAD_SELECT)) input |= IN_SELECT;
+            if (pressed(buttons, GAMEPAD_START)) input |= IN_START;
+            Role::sampled(input);
+
+            if (pressed(buttons, GAMEPAD_SELECT)) {
+                cycle(localAcceleration);
+                Serial.print("Button Accel: "); Serial.print(localAcceleration);
+                delay(Role::selectPauseMs);
+            }
+            if (pressed(buttons, GAMEPAD_START)) {
+                warpDot();
+                delay(Role::startPauseMs);
+            }
+        }
+
+        render();
+    }
+
+    // Call once the gamepad is up, with the stick at rest
+    void calibrate() { stick.calibrate(gamePad); }
+
+    // The filtered stick, for the lockstep / authoritative input sampling
+    Joystick &joystick() { return stick; }
+
+    // True while the dots are apart (false means game over)
+    bool checkDistance() const {
+        return !dotsCollide(localX, localY, otherX, otherY);
+    }
+
+    // Moves our dot somewhere random
+    void warpDot() {
+        localX = rand() % M5.Lcd.width();
+        localY = rand() % M5.Lcd.height();
+        Role::warped(localX, localY);
+    }
+
+    // Draws from a task of its own on CORE_GAME instead of inside play(); with
+    // `dma`, in pipelined DMA strips (falls back to plain drawing without DMA)
+    bool startRenderTask(UBaseType_t priority, bool dma = false) {
+        if (dma && !strips.begin(M5.Lcd.width(), M5.Lcd.height()))
+            Serial.println("LCD DMA unavailable, drawing frames without it");
+        return renderer.begin(drawOnTask, this, priority, CORE_GAME);
+    }
+
+    // The dots on a cleared screen, on the render task if there is one
+    void render() {
+        uint32_t startUs = micros();
+        DotFrame frame = { (int16_t)localX, (int16_t)localY, (int16_t)otherX, (int16_t)otherY };
+        framesRendered++;
+        if (hidden)
+            return;
+        if (renderer.running())
+            renderer.submit(frame);
+        else
+            drawFrame(frame);
+        renderCallUs += micros() - startUs;
+    }
+
+    // Time spent in render() since the last call: drawing, or just handing
+    // frames to the render task
+    uint32_t takeRenderUs() {
+        uint32_t us = renderCallUs;
+        renderCallUs = 0;
+        return us;
+    }
+
+    // Waits until no frame can be drawn over what the caller draws next
+    void flushRender() { renderer.flush(); }
+
+    // While hidden, frames are still simulated (play(), render()) but not
+    // drawn; the first one after showing again redraws the whole screen
+    void hide(bool hide) {
+        if (hide && !hidden)
+            renderer.flush();
+        hidden = hide;
+    }
+
+    // Logs the frames simulated (render() calls) and drawn per second, and the
+    // time per draw, every `intervalMs`
+    void reportRender(unsigned long intervalMs) {
+        unsigned long now = millis();
+        if (now - lastRenderReport < intervalMs)
+            return;
+        float seconds = (now - lastRenderReport) / 1000.0;
+        uint32_t rendered = framesRendered, drawn = framesDrawn, drawnUs = drawUs;
+        Serial.printf("Frames: %.1f/s simulated, %.1f/s drawn, %.2f ms per draw, %lu replaced (%s)\n",
+                      (rendered - reportedRendered) / seconds, (drawn - reportedDrawn) / seconds,
+                      drawn != reportedDrawn ? (drawnUs - reportedDrawUs) / 1000.0 / (drawn - reportedDrawn) : 0.0,
+                      (unsigned long)renderer.dropped(),
+                      strips.ready() ? "DMA strips" : renderer.running() ? "render task" : "inline");
+        lastRenderReport = now;
+        reportedRendered = rendered;
+        reportedDrawn = drawn;
+        reportedDrawUs = drawnUs;
+    }
+
+    void endGame(long lastedMs) {
+        flushRender();
+        StatusScreen::drawnOver();
+        M5.Lcd.fillScreen(TFT_MAGENTA);
+        M5.Lcd.setTextColor(TFT_BLACK);
+        M5.Lcd.setTextSize(3);
+        M5.Lcd.drawString("GAME OVER", M5.Lcd.width() / 4, M5.Lcd.height() / 2 - 30);
+        M5.Lcd.setTextSize(2);
+        M5.Lcd.drawString("YOU LASTED FOR", M5.Lcd.width() / 4, M5.Lcd.height() / 2);
+        M5.Lcd.drawString(milis_to_seconds(lastedMs), M5.Lcd.width() / 4, M5.Lcd.height() - 100);
+    }
+
+private:
+    static bool pressed(uint32_t buttons, int button) { return !(buttons & (1UL << button)); }
+
+    static void drawOnTask(const DotFrame &frame, void *engine) {
+        ((GameEngine *)engine)->drawFrame(frame);
+    }
+
+    void drawFrame(const DotFrame &frame) {
+        uint32_t startUs = micros();
+        StatusScreen::drawnOver();
+        if (strips.ready()) {
+            int width = M5.Lcd.width();
+            strips.push([&](uint16_t *buffer, int y, int lines) {
+                memset(buffer, 0, width * lines * sizeof(uint16_t));   // TFT_BLACK
+                plot(buffer, width, y, lines, frame.localX, frame.localY, Role::localColor);
+                plot(buffer, width, y, lines, frame.otherX, frame.otherY, Role::otherColor);
+            });
+        } else {
+            M5.Lcd.fillScreen(TFT_BLACK);
+            M5.Lcd.drawPixel(frame.localX, frame.localY, Role::localColor);
+            M5.Lcd.drawPixel(frame.otherX, frame.otherY, Role::otherColor);
+        }
+        drawUs += micros() - startUs;
+        framesDrawn++;
+    }
+
+    // One pixel into a strip, if it falls inside it
+    static void plot(uint16_t *buffer, int width, int y, int lines, int x, int pixelY, uint16_t color) {
+        if (x >= 0 && x < width && pixelY >= y && pixelY < y + lines)
+            buffer[(pixelY - y) * width + x] = DmaStrips::swapped(color);
+    }
+
+    static void move(Motion &motion, int &x, int &y, int acceleration, int xAmount, int yAmount,
+                     uint32_t elapsedMs) {
+        if (x != motionX(motion) || y != motionY(motion))
+            motionReset(motion, x, y);
+        motionStep(motion, xAmount, yAmount, acceleration, elapsedMs);
+        x = motionX(motion);
+        y = motionY(motion);
+    }
+
+    static void cycle(int &acceleration) {
+        Dot dot = { 0, 0, (uint8_t)acceleration };
+        cycleAcceleration(dot);
+        acceleration = dot.acceleration;
+    }
+
+    Adafruit_seesaw &gamePad;
+    Joystick stick;
+    FrameRenderer renderer;
+    DmaStrips strips;
+    int &localX;
+    int &localY;
+    int &localAcceleration;
+    int &otherX;
+    int &otherY;
+    int unusedAcceleration = 1;
+    int &otherAcceleration;
+    Motion localMotion = {};
+    Motion otherMotion = {};
+    unsigned long lastFrameMs = 0;
+    bool hidden = false;
+
+    // Render statistics; the drawn ones are written by the render task
+    uint32_t framesRendered = 0;
+    uint32_t renderCallUs = 0;
+    volatile uint32_t framesDrawn = 0;
+    volatile uint32_t drawUs = 0;
+    unsigned long lastRenderReport = 0;
+    uint32_t reportedRendered = 0;
+    uint32_t reportedDrawn = 0;
+    uint32_t reportedDrawUs = 0;
+};
+
+#endif
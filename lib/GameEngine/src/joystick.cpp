@@ -0,0 +1,76 @@
+#include "joystick.h"
+
+// Centers implied by the old fixed thresholds (x > 600 / x < 500, y < 480 / y > 560)
+#define JOY_FALLBACK_CENTER_X 550
+#define JOY_FALLBACK_CENTER_Y (1023 - 520)
+#define JOY_MAX_CENTER_ERROR 150
+
+void Joystick::calibrate(Adafruit_seesaw &gamePad) {
+    long sumX = 0, sumY = 0;
+    for (int i = 0; i < JOY_CALIBRATION_SAMPLES; i++) {
+        sumX += 1023 - gamePad.analogRead(14);
+        sumY += gamePad.analogRead(15);
+        delay(5);
+    }
+    xAxis = Axis();
+    yAxis = Axis();
+    xAxis.center = sumX / JOY_CALIBRATION_SAMPLES;
+    yAxis.center = sumY / JOY_CALIBRATION_SAMPLES;
+    if (abs(xAxis.center - 512) > JOY_MAX_CENTER_ERROR || abs(yAxis.center - 512) > JOY_MAX_CENTER_ERROR) {
+        Serial.printf("Joystick off center at boot (%d, %d), using defaults\n", xAxis.center, yAxis.center);
+        xAxis.center = JOY_FALLBACK_CENTER_X;
+        yAxis.center = JOY_FALLBACK_CENTER_Y;
+    }
+    Serial.printf("Joystick center: %d, %d\n", xAxis.center, yAxis.center);
+}
+
+///////////////////////////////////////////////////////////////
+// Reversed so that larger means right / down on the screen
+///////////////////////////////////////////////////////////////
+void Joystick::read(Adafruit_seesaw &gamePad) {
+    update(1023 - gamePad.analogRead(14), gamePad.analogRead(15));
+}
+
+void Joystick::update(int rawX, int rawY) {
+    xAxis.update(rawX);
+    yAxis.update(rawY);
+}
+
+uint8_t Joystick::direction() const {
+    uint8_t input = 0;
+    if (xAxis.engaged > 0) input |= IN_X_POS;
+    else if (xAxis.engaged < 0) input |= IN_X_NEG;
+    if (yAxis.engaged > 0) input |= IN_Y_POS;
+    else if (yAxis.engaged < 0) input |= IN_Y_NEG;
+    return input;
+}
+
+///////////////////////////////////////////////////////////////
+// Filter, then engage past JOY_ENGAGE and release inside
+// JOY_RELEASE; the deflection is scaled from the release edge
+// to the largest offset seen so far
+///////////////////////////////////////////////////////////////
+void Joystick::Axis::update(int raw) {
+    if (filtered < 0)
+        filtered = (int32_t)raw << JOY_FILTER_SHIFT;
+    else
+        filtered += (((int32_t)raw << JOY_FILTER_SHIFT) - filtered) >> JOY_FILTER_SHIFT;
+
+    int offset = (filtered >> JOY_FILTER_SHIFT) - center;
+    int magnitude = abs(offset);
+    int8_t sign = offset > 0 ? 1 : -1;
+    if (magnitude > range)
+        range = magnitude;
+
+    if (engaged != 0 && (magnitude < JOY_RELEASE || sign != engaged))
+        engaged = 0;
+    if (engaged == 0 && magnitude > JOY_ENGAGE)
+        engaged = sign;
+
+    if (engaged == 0) {
+        amount = 0;
+        return;
+    }
+    int scaled = (magnitude - JOY_RELEASE) * MOTION_FULL / (range - JOY_RELEASE);
+    amount = engaged * constrain(scaled, 1, MOTION_FULL);
+}
@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////////////////
+// Gamepad QT joystick: calibrated at boot, low-pass filtered,
+// with hysteresis around the dead zone so stick noise near the
+// edge doesn't toggle movement (and the BLE updates it sends).
+// Gives both the direction bits the lockstep input uses and a
+// proportional deflection for GameEngine's motion.
+///////////////////////////////////////////////////////////////
+#ifndef JOYSTICK_H
+#define JOYSTICK_H
+
+#include <Arduino.h>
+#include <Adafruit_seesaw.h>
+#include <game_core.h>
+
+#define JOY_CALIBRATION_SAMPLES 16
+#define JOY_FILTER_SHIFT 1          // IIR: each sample moves the estimate 1/2 of the way
+#define JOY_ENGAGE 60               // counts off center to start moving...
+#define JOY_RELEASE 35              // ...and back inside this to stop
+#define JOY_RANGE 400               // counts to full deflection until more is seen
+
+class Joystick {
+public:
+    // Takes the resting position as center; the stick must be left alone at boot.
+    // A center too far off (stick held) falls back to the old fixed thresholds.
+    void calibrate(Adafruit_seesaw &gamePad);
+
+    // One sample from the gamepad, or a raw one (already reversed to match the screen)
+    void read(Adafruit_seesaw &gamePad);
+    void update(int rawX, int rawY);
+
+    // IN_X_* / IN_Y_* bits for the engaged axes
+    uint8_t direction() const;
+
+    // Deflection in [-MOTION_FULL, MOTION_FULL], 0 inside the dead zone
+    int x() const { return xAxis.amount; }
+    int y() const { return yAxis.amount; }
+
+private:
+    struct Axis {
+        int center = 512;
+        int range = JOY_RANGE;
+        int32_t filtered = -1;      // counts << JOY_FILTER_SHIFT, -1 until the first sample
+        int8_t engaged = 0;         // -1, 0, 1
+        int amount = 0;
+
+        void update(int raw);
+    };
+
+    Axis xAxis, yAxis;
+};
+
+#endif
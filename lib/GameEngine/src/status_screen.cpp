@@ -0,0 +1,68 @@
+#include "status_screen.h"
+
+volatile bool StatusScreen::lcdDrawnOver = false;
+
+void StatusScreen::show(const String &text, uint16_t background, uint8_t textSize) {
+    bool intact = shown && !lcdDrawnOver && background == shownBackground && textSize == shownTextSize;
+    if (intact && text == shownText)
+        return;
+    M5.Lcd.setTextSize(textSize);
+    if (!intact || !redrawChangedLines(text, background)) {
+        M5.Lcd.fillScreen(background);
+        M5.Lcd.setCursor(0, 0);
+        M5.Lcd.println(text);
+    }
+    lcdDrawnOver = false;
+    shown = true;
+    shownText = text;
+    shownBackground = background;
+    shownTextSize = textSize;
+}
+
+///////////////////////////////////////////////////////////////
+// Line by line against what is shown; false (redraw it all) if
+// either text has more lines than fit or a line long enough to
+// wrap, since then lines no longer sit one font height apart
+///////////////////////////////////////////////////////////////
+bool StatusScreen::redrawChangedLines(const String &text, uint16_t background) {
+    String oldLines[STATUS_MAX_LINES], newLines[STATUS_MAX_LINES];
+    int oldCount = splitLines(shownText, oldLines);
+    int newCount = splitLines(text, newLines);
+    if (oldCount < 0 || newCount < 0)
+        return false;
+    for (int i = 0; i < oldCount; i++)
+        if (M5.Lcd.textWidth(oldLines[i]) > M5.Lcd.width())
+            return false;
+    for (int i = 0; i < newCount; i++)
+        if (M5.Lcd.textWidth(newLines[i]) > M5.Lcd.width())
+            return false;
+
+    int lineHeight = M5.Lcd.fontHeight();
+    int count = oldCount > newCount ? oldCount : newCount;
+    for (int i = 0; i < count; i++) {
+        if (i < oldCount && i < newCount && oldLines[i] == newLines[i])
+            continue;
+        M5.Lcd.fillRect(0, i * lineHeight, M5.Lcd.width(), lineHeight, background);
+        if (i < newCount) {
+            M5.Lcd.setCursor(0, i * lineHeight);
+            M5.Lcd.print(newLines[i]);
+        }
+    }
+    return true;
+}
+
+// Number of lines, or -1 if there are more than STATUS_MAX_LINES
+int StatusScreen::splitLines(const String &text, String lines[STATUS_MAX_LINES]) {
+    int count = 0;
+    int start = 0;
+    while (start <= (int)text.length()) {
+        if (count == STATUS_MAX_LINES)
+            return -1;
+        int end = text.indexOf('\n', start);
+        if (end < 0)
+            end = text.length();
+        lines[count++] = text.substring(start, end);
+        start = end + 1;
+    }
+    return count;
+}
@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////
+// Status screens (connecting, disconnected, ...): keeps what is
+// on the LCD and redraws only when that changes, so a sketch can
+// show its status on every loop() without pushing a full screen
+// over SPI each time. When only some lines of the text change
+// on the same background, just those lines are cleared and
+// drawn again.
+//
+// Anything else that draws on the LCD (GameEngine's frames and
+// game over screen) calls drawnOver() so the next show() starts
+// from a clean screen.
+///////////////////////////////////////////////////////////////
+#ifndef STATUS_SCREEN_H
+#define STATUS_SCREEN_H
+
+#include <M5Core2.h>
+
+#define STATUS_MAX_LINES 16
+#define STATUS_TEXT_SIZE 3          // the sketches' status screens
+
+class StatusScreen {
+public:
+    // Shows `text` (println'd from the top left) on `background`
+    void show(const String &text, uint16_t background, uint8_t textSize = STATUS_TEXT_SIZE);
+
+    // The LCD no longer shows the status screen; safe from any task
+    static void drawnOver() { lcdDrawnOver = true; }
+
+private:
+    bool redrawChangedLines(const String &text, uint16_t background);
+    static int splitLines(const String &text, String lines[STATUS_MAX_LINES]);
+
+    static volatile bool lcdDrawnOver;
+    bool shown = false;
+    String shownText;
+    uint16_t shownBackground = 0;
+    uint8_t shownTextSize = 0;
+};
+
+#endif
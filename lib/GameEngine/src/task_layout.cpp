@@ -0,0 +1,61 @@
+#include "task_layout.h"
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+
+volatile uint32_t CoreLoad::lastHookUs[2] = {};
+volatile uint32_t CoreLoad::idleUs[2] = {};
+
+void setGameLoopPriority(UBaseType_t priority) {
+    vTaskPrioritySet(NULL, priority);
+    Serial.printf("Tasks: BLE on core %d, game on core %d (priority %u)\n", CORE_BLE, xPortGetCoreID(),
+                  (unsigned)priority);
+    if (xPortGetCoreID() != CORE_GAME)
+        Serial.printf("WARNING: game loop is not on core %d\n", CORE_GAME);
+}
+
+bool CoreLoad::begin() {
+    sampledAtUs = (uint32_t)esp_timer_get_time();
+    return esp_register_freertos_idle_hook_for_cpu(idleHook0, 0) == ESP_OK &&
+           esp_register_freertos_idle_hook_for_cpu(idleHook1, 1) == ESP_OK;
+}
+
+// Returning false keeps the idle task calling us instead of waiting for an interrupt
+bool CoreLoad::idleHook0() {
+    countIdle(0);
+    return false;
+}
+
+bool CoreLoad::idleHook1() {
+    countIdle(1);
+    return false;
+}
+
+void CoreLoad::countIdle(int core) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t gap = now - lastHookUs[core];
+    if (gap < CORE_LOAD_IDLE_GAP_US)
+        idleUs[core] += gap;
+    lastHookUs[core] = now;
+}
+
+void CoreLoad::sample(uint8_t busyPercent[2]) {
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t elapsed = now - sampledAtUs;
+    sampledAtUs = now;
+    for (int core = 0; core < 2; core++) {
+        uint32_t idle = idleUs[core];
+        uint32_t idleSince = idle - sampledIdleUs[core];
+        sampledIdleUs[core] = idle;
+        uint32_t idlePercent = elapsed > 0 ? (uint64_t)idleSince * 100 / elapsed : 100;
+        busyPercent[core] = idlePercent < 100 ? 100 - idlePercent : 0;
+    }
+}
+
+void CoreLoad::report(unsigned long intervalMs) {
+    if (millis() - lastReport < intervalMs)
+        return;
+    lastReport = millis();
+    uint8_t busy[2];
+    sample(busy);
+    Serial.printf("Core load: core 0 (BLE) %u%%, core 1 (game) %u%%\n", busy[0], busy[1]);
+}
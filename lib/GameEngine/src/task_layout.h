@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////
+// Which task runs where on the Core2's two cores. Bluedroid's
+// tasks (the BLE host, and with it every GATT callback) are
+// pinned to core 0 by the SDK configuration and Arduino's loop()
+// runs on core 1, so everything the sketches start follows the
+// same split: BLE work on CORE_BLE, simulation and rendering on
+// CORE_GAME, and radio bursts never compete with a frame.
+//
+// CoreLoad reports how busy each core is, measured from its
+// idle task: while it is enabled the idle tasks spin through
+// our hook instead of sleeping, and the time between
+// back-to-back hook calls is the time the core was idle.
+///////////////////////////////////////////////////////////////
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include <Arduino.h>
+
+#define CORE_BLE 0
+#define CORE_GAME 1
+#define CORE_LOAD_IDLE_GAP_US 25    // longer between idle hook calls means something else ran
+
+#if defined(CONFIG_BT_BLUEDROID_PINNED_TO_CORE) && CONFIG_BT_BLUEDROID_PINNED_TO_CORE != CORE_BLE
+#warning "Bluedroid is not pinned to CORE_BLE; BLE callbacks will share a core with the game"
+#endif
+#if defined(ARDUINO_RUNNING_CORE) && ARDUINO_RUNNING_CORE != CORE_GAME
+#warning "loop() does not run on CORE_GAME"
+#endif
+
+// Gives the calling task (loop(), from setup()) `priority` and logs the layout
+void setGameLoopPriority(UBaseType_t priority);
+
+class CoreLoad {
+public:
+    // Installs the idle hooks on both cores
+    bool begin();
+
+    // Percent of the time each core was busy since the previous call (at
+    // least once an hour, the counters wrap)
+    void sample(uint8_t busyPercent[2]);
+
+    // Logs both cores' load every `intervalMs`
+    void report(unsigned long intervalMs);
+
+private:
+    static bool idleHook0();
+    static bool idleHook1();
+    static void countIdle(int core);
+
+    // 32-bit so the other core reads them whole; only differences are used
+    static volatile uint32_t lastHookUs[2];
+    static volatile uint32_t idleUs[2];
+    uint32_t sampledIdleUs[2] = {};
+    uint32_t sampledAtUs = 0;
+    unsigned long lastReport = 0;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "link_emulator.h"
+
+void LinkChannel::configure(const LinkConfig &linkConfig, uint32_t seed) {
+    config = linkConfig;
+    if (config.connectionIntervalUs == 0)
+        config.connectionIntervalUs = 1;
+    if (config.packetsPerEvent == 0)
+        config.packetsPerEvent = 1;
+    rng.seed(seed);
+    clear();
+    stats = LinkStats();
+}
+
+bool LinkChannel::send(const void *data, size_t length, uint64_t nowUs) {
+    stats.sent++;
+    if (!up || random(1000) < config.lossPerMille) {
+        stats.dropped++;
+        return false;
+    }
+
+    // Leave on the next connection event with room, like a full TX buffer would
+    uint64_t interval = config.connectionIntervalUs;
+    uint64_t nextEventUs = (nowUs + interval - 1) / interval * interval;
+    if (nextEventUs > eventUs) {
+        eventUs = nextEventUs;
+        eventPackets = 0;
+    }
+    if (eventPackets == config.packetsPerEvent) {
+        eventUs += interval;
+        eventPackets = 0;
+    }
+    eventPackets++;
+
+    LinkPacket packet;
+    packet.data.assign((const uint8_t *)data, (const uint8_t *)data + length);
+    packet.sentUs = nowUs;
+    packet.arrivalUs = eventUs + config.latencyUs + random(config.jitterUs + 1);
+    if (random(1000) < config.reorderPerMille) {
+        packet.arrivalUs += interval;
+        stats.reordered++;
+    }
+    packet.order = order++;
+    inFlight.push(packet);
+    return true;
+}
+
+bool LinkChannel::receive(uint64_t nowUs, LinkPacket &packet) {
+    if (inFlight.empty() || inFlight.top().arrivalUs > nowUs)
+        return false;
+    packet = inFlight.top();
+    inFlight.pop();
+    stats.delivered++;
+    return true;
+}
+
+void LinkChannel::clear() {
+    while (!inFlight.empty())
+        inFlight.pop();
+    eventUs = 0;
+    eventPackets = 0;
+}
+
+EmulatedLink::EmulatedLink(const LinkConfig &config) {
+    toClient.configure(config, config.seed);
+    toServer.configure(config, config.seed * 2654435761u + 1);
+}
+
+void EmulatedLink::setConnected(bool connected) {
+    if (up && !connected) {
+        toClient.clear();
+        toServer.clear();
+    }
+    up = connected;
+    toClient.setUp(connected);
+    toServer.setUp(connected);
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////
+// Link emulator for the host builds: a loopback stand-in for
+// the BLE link between a simulated server and client in one
+// process. Packets only leave on connection events (a limited
+// number per event, like the controller's TX buffers), then
+// arrive after latency + jitter, possibly reordered or lost.
+// Time is whatever the caller says it is, in microseconds, so
+// simulations run as fast as the host can step them.
+///////////////////////////////////////////////////////////////
+#ifndef LINK_EMULATOR_H
+#define LINK_EMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <queue>
+#include <vector>
+#include <game_core.h>
+
+struct LinkConfig {
+    uint32_t latencyUs = 5000;              // one-way air + stack delay
+    uint32_t jitterUs = 0;                  // extra delay, uniform in [0, jitterUs]
+    uint32_t lossPerMille = 0;              // packets dropped
+    uint32_t reorderPerMille = 0;           // packets held one extra connection interval
+    uint32_t connectionIntervalUs = 30000;  // packets leave on these boundaries
+    uint32_t packetsPerEvent = 4;           // sent per connection event, the rest wait
+    uint32_t seed = 1;
+};
+
+struct LinkPacket {
+    std::vector<uint8_t> data;
+    uint64_t sentUs;        // when send() was called
+    uint64_t arrivalUs;
+    uint32_t order;         // send order, to keep equal arrival times stable
+};
+
+struct LinkStats {
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+    uint32_t reordered = 0;
+    uint32_t delivered = 0;
+};
+
+// One direction of the link
+class LinkChannel {
+public:
+    void configure(const LinkConfig &config, uint32_t seed);
+
+    // Queues a packet; returns false if it was dropped (loss or link down)
+    bool send(const void *data, size_t length, uint64_t nowUs);
+    // Pops the next packet that has arrived by `nowUs`
+    bool receive(uint64_t nowUs, LinkPacket &packet);
+    // Drops everything in flight (disconnect)
+    void clear();
+    // While down every packet sent is dropped
+    void setUp(bool linkUp) { up = linkUp; }
+
+    LinkStats stats;
+
+private:
+    struct Later {
+        bool operator()(const LinkPacket &a, const LinkPacket &b) const {
+            return a.arrivalUs != b.arrivalUs ? a.arrivalUs > b.arrivalUs : a.order > b.order;
+        }
+    };
+
+    uint32_t random(uint32_t range) { return range == 0 ? 0 : rng.next() % range; }
+
+    LinkConfig config;
+    GameRng rng;
+    bool up = true;
+    uint64_t eventUs = 0;           // connection event the last packet left on
+    uint32_t eventPackets = 0;      // packets already sent on that event
+    uint32_t order = 0;
+    std::priority_queue<LinkPacket, std::vector<LinkPacket>, Later> inFlight;
+};
+
+// Both directions plus the connection itself
+class EmulatedLink {
+public:
+    explicit EmulatedLink(const LinkConfig &config);
+
+    // Server -> client (notifications) and client -> server (writes)
+    LinkChannel toClient;
+    LinkChannel toServer;
+
+    // While down every packet is dropped; going down also drops those in flight
+    void setConnected(bool connected);
+    bool connected() const { return up; }
+
+private:
+    bool up = true;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "match_recorder.h"
+
+bool MatchRecorder::begin(fs::FS &fs, const char *prefix, RecordRole role, RecordMode mode, BaseType_t core) {
+    char path[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(path, sizeof(path), "/%s%03d.rec", prefix, i);
+        if (!fs.exists(path))
+            break;
+    }
+    file = fs.open(path, FILE_WRITE);
+    if (!file) {
+        Serial.printf("Recorder: can't create %s\n", path);
+        return false;
+    }
+
+    RecordFileHeader header = { RECORD_MAGIC, RECORD_VERSION, role, mode, (uint32_t)millis() };
+    file.write((uint8_t *)&header, sizeof(header));
+    buffer = xRingbufferCreate(RECORDER_BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF);
+    xTaskCreatePinnedToCore(flushTask, "recorder", 4096, this, 1, NULL, core);
+    Serial.printf("Recording to %s\n", path);
+    return true;
+}
+
+void MatchRecorder::input(RecordSide side, uint8_t input) {
+    RecordInput record = { side, input };
+    append(REC_INPUT, &record, sizeof(record));
+}
+
+void MatchRecorder::position(int xServer, int yServer, int xClient, int yClient) {
+    RecordPosition record = { (int16_t)xServer, (int16_t)yServer, (int16_t)xClient, (int16_t)yClient };
+    append(REC_POSITION, &record, sizeof(record));
+}
+
+void MatchRecorder::ble(RecordBleEvent event, uint16_t handle, uint16_t value) {
+    RecordBle record = { event, handle, value };
+    append(REC_BLE, &record, sizeof(record));
+}
+
+void MatchRecorder::match(uint32_t sessionId, uint8_t screen) {
+    RecordMatch record = { sessionId, screen };
+    append(REC_MATCH, &record, sizeof(record));
+}
+
+///////////////////////////////////////////////////////////////
+// One send per record keeps records whole when several tasks
+// append at once; a full buffer drops the record, never waits
+///////////////////////////////////////////////////////////////
+void MatchRecorder::append(RecordType type, const void *payload, uint8_t length) {
+    if (buffer == nullptr)
+        return;
+    uint8_t record[sizeof(RecordHeader) + 16];
+    RecordHeader header = { type, length, (uint32_t)micros() };
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), payload, length);
+    if (xRingbufferSend(buffer, record, sizeof(header) + length, 0) != pdTRUE)
+        droppedRecords++;
+}
+
+void MatchRecorder::flushTask(void *parameter) {
+    MatchRecorder *recorder = (MatchRecorder *)parameter;
+    unsigned long lastFlush = millis();
+    uint32_t reportedDrops = 0;
+    while (true) {
+        size_t length;
+        uint8_t *data = (uint8_t *)xRingbufferReceiveUpTo(recorder->buffer, &length,
+            pdMS_TO_TICKS(RECORDER_FLUSH_MS), 512);
+        if (data != nullptr) {
+            recorder->file.write(data, length);
+            vRingbufferReturnItem(recorder->buffer, data);
+        }
+        if (millis() - lastFlush >= RECORDER_FLUSH_MS) {
+            lastFlush = millis();
+            recorder->file.flush();
+            if (recorder->droppedRecords != reportedDrops) {
+                reportedDrops = recorder->droppedRecords;
+                Serial.printf("Recorder: %u records dropped\n", reportedDrops);
+            }
+        }
+    }
+}
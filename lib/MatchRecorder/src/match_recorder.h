@@ -0,0 +1,42 @@
+///////////////////////////////////////////////////////////////
+// Match recorder: appends timestamped records (see
+// lib/GameCore/src/match_record.h) to a file on LittleFS or SD.
+// Appending only copies into a RAM ring buffer, so it is safe
+// from loop() and the BLE callbacks alike; a background task
+// does the (slow) file writes.
+///////////////////////////////////////////////////////////////
+#ifndef MATCH_RECORDER_H
+#define MATCH_RECORDER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/ringbuf.h>
+#include <match_record.h>
+
+#define RECORDER_BUFFER_SIZE 8192   // RAM ring buffer (~1000 records)
+#define RECORDER_FLUSH_MS 1000      // file flush interval
+
+class MatchRecorder {
+public:
+    // Opens the next free /<prefix>NNN.rec on `fs` and starts the flush task
+    // on `core`. Returns false (and records nothing) if the file can't be made.
+    bool begin(fs::FS &fs, const char *prefix, RecordRole role, RecordMode mode, BaseType_t core = 0);
+
+    void input(RecordSide side, uint8_t input);
+    void position(int xServer, int yServer, int xClient, int yClient);
+    void ble(RecordBleEvent event, uint16_t handle = 0, uint16_t value = 0);
+    void match(uint32_t sessionId, uint8_t screen);
+
+    // Records lost because the buffer was full
+    uint32_t dropped() const { return droppedRecords; }
+
+private:
+    void append(RecordType type, const void *payload, uint8_t length);
+    static void flushTask(void *parameter);
+
+    File file;
+    RingbufHandle_t buffer = nullptr;
+    volatile uint32_t droppedRecords = 0;
+};
+
+#endif
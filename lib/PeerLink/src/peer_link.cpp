@@ -0,0 +1,223 @@
+#include "peer_link.h"
+
+PeerLink *PeerLink::instance = nullptr;
+
+///////////////////////////////////////////////////////////////
+// BLE callbacks, forwarded to the link
+///////////////////////////////////////////////////////////////
+class PeerLink::ServerCallbacks : public BLEServerCallbacks {
+public:
+    ServerCallbacks(PeerLink &link) : link(link) {}
+    void onConnect(BLEServer *pServer) { link.onPeerConnected(); }
+    void onDisconnect(BLEServer *pServer) { link.onDisconnected(); }
+private:
+    PeerLink &link;
+};
+
+class PeerLink::ClientCallbacks : public BLEClientCallbacks {
+public:
+    ClientCallbacks(PeerLink &link) : link(link) {}
+    void onConnect(BLEClient *pclient) {}
+    void onDisconnect(BLEClient *pclient) { link.onDisconnected(); }
+private:
+    PeerLink &link;
+};
+
+// The central's writes
+class PeerLink::CharacteristicCallbacks : public BLECharacteristicCallbacks {
+public:
+    CharacteristicCallbacks(PeerLink &link) : link(link) {}
+    void onWrite(BLECharacteristic *pCharacteristic) {
+        std::string value = pCharacteristic->getValue();
+        if (value.length() != sizeof(PeerPosition))
+            return;
+        PeerPosition position;
+        memcpy(&position, value.data(), sizeof(position));
+        link.received(position.x, position.y);
+    }
+private:
+    PeerLink &link;
+};
+
+// The central subscribing to our notifications is what makes the link ready
+class PeerLink::CccdCallbacks : public BLEDescriptorCallbacks {
+public:
+    CccdCallbacks(PeerLink &link) : link(link) {}
+    void onWrite(BLEDescriptor *pDescriptor) {
+        if (link.state == PEER_PERIPHERAL)
+            link.ready = ((BLE2902 *)pDescriptor)->getNotifications();
+    }
+private:
+    PeerLink &link;
+};
+
+class PeerLink::ScanCallbacks : public BLEAdvertisedDeviceCallbacks {
+public:
+    ScanCallbacks(PeerLink &link) : link(link) {}
+    void onResult(BLEAdvertisedDevice advertisedDevice) { link.onFound(advertisedDevice); }
+private:
+    PeerLink &link;
+};
+
+///////////////////////////////////////////////////////////////
+// The peer service: one position characteristic the central
+// writes and the peripheral notifies
+///////////////////////////////////////////////////////////////
+void PeerLink::begin(const char *name, Receiver received) {
+    instance = this;
+    this->received = received;
+    BLEDevice::init(name);
+
+    BLEServer *server = BLEDevice::createServer();
+    server->setCallbacks(new ServerCallbacks(*this));
+    BLEService *service = server->createService(PEER_SERVICE_UUID);
+    characteristic = service->createCharacteristic(PEER_POSITION_CHARACTERISTIC_UUID,
+        BLECharacteristic::PROPERTY_NOTIFY |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    characteristic->setCallbacks(new CharacteristicCallbacks(*this));
+    BLE2902 *cccd = new BLE2902();
+    cccd->setCallbacks(new CccdCallbacks(*this));
+    characteristic->addDescriptor(cccd);
+    service->start();
+
+    BLEAdvertising *bleAdvertising = BLEDevice::getAdvertising();
+    bleAdvertising->addServiceUUID(PEER_SERVICE_UUID);
+    bleAdvertising->setScanResponse(true);
+
+    client = BLEDevice::createClient();
+    client->setClientCallbacks(new ClientCallbacks(*this));
+
+    BLEScan *pBLEScan = BLEDevice::getScan();
+    pBLEScan->setAdvertisedDeviceCallbacks(new ScanCallbacks(*this));
+    pBLEScan->setInterval(1349);
+    pBLEScan->setWindow(449);
+    pBLEScan->setActiveScan(true);
+
+    Serial.printf("Peer link: %s, looking for the other peer\n", BLEDevice::getAddress().toString().c_str());
+    discover();
+}
+
+void PeerLink::update() {
+    if (received == nullptr)
+        return;
+    if (restart) {
+        restart = false;
+        discover();
+    }
+    switch (state) {
+        case PEER_DISCOVERING:
+            startScan();
+            break;
+        case PEER_CONNECTING:
+            connect();
+            break;
+        case PEER_WAITING:
+            if (millis() - electedAt > PEER_WAIT_MS) {
+                Serial.println("Peer link: the peer never connected, scanning again");
+                discover();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void PeerLink::send(int x, int y) {
+    if (!ready)
+        return;
+    PeerPosition position = { (int16_t)x, (int16_t)y };
+    if (state == PEER_CENTRAL) {
+        remote->writeValue((uint8_t *)&position, sizeof(position), false);
+    } else {
+        characteristic->setValue((uint8_t *)&position, sizeof(position));
+        characteristic->notify();
+    }
+}
+
+void PeerLink::discover() {
+    ready = false;
+    state = PEER_DISCOVERING;
+    BLEDevice::startAdvertising();
+    startScan();
+}
+
+void PeerLink::startScan() {
+    if (scanning)
+        return;
+    scanning = true;
+    BLEDevice::getScan()->clearResults();
+    BLEDevice::getScan()->start(PEER_SCAN_SECONDS, scanComplete, false);
+}
+
+void PeerLink::scanComplete(BLEScanResults results) {
+    instance->scanning = false;
+}
+
+///////////////////////////////////////////////////////////////
+// Election: both sides compare the same two addresses, so they
+// agree on who connects without exchanging anything
+///////////////////////////////////////////////////////////////
+void PeerLink::onFound(BLEAdvertisedDevice &device) {
+    if (state != PEER_DISCOVERING || !device.haveServiceUUID() ||
+            !device.isAdvertisingService(BLEUUID(PEER_SERVICE_UUID)))
+        return;
+    BLEAddress ours = BLEDevice::getAddress();
+    BLEAddress theirs = device.getAddress();
+    bool win = memcmp(*ours.getNative(), *theirs.getNative(), ESP_BD_ADDR_LEN) < 0;
+    memcpy(peerAddress, *theirs.getNative(), ESP_BD_ADDR_LEN);
+    peerAddressType = device.getAddressType();
+    electedAt = millis();
+    state = win ? PEER_CONNECTING : PEER_WAITING;
+    BLEDevice::getScan()->stop();
+    Serial.printf("Peer link: found %s, %s\n", theirs.toString().c_str(),
+                  win ? "connecting to it" : "waiting for it to connect");
+}
+
+///////////////////////////////////////////////////////////////
+// We won: stop advertising (nobody else should connect) and
+// subscribe to the peer's notifications
+///////////////////////////////////////////////////////////////
+void PeerLink::connect() {
+    BLEDevice::getAdvertising()->stop();
+    // Set first: our own server also sees this connection, and must not take it as the peer's
+    state = PEER_CENTRAL;
+    if (!client->connect(BLEAddress(peerAddress), peerAddressType)) {
+        Serial.println("Peer link: FAILED to connect");
+        discover();
+        return;
+    }
+    BLERemoteService *service = client->getService(BLEUUID(PEER_SERVICE_UUID));
+    remote = service != nullptr ? service->getCharacteristic(BLEUUID(PEER_POSITION_CHARACTERISTIC_UUID)) : nullptr;
+    if (remote == nullptr || !remote->canNotify()) {
+        Serial.println("Peer link: no position characteristic on the peer");
+        client->disconnect();
+        discover();
+        return;
+    }
+    remote->registerForNotify(notified);
+    ready = true;
+    Serial.println("Peer link: connected as central");
+}
+
+void PeerLink::onPeerConnected() {
+    if (state == PEER_CONNECTING || state == PEER_CENTRAL)
+        return;
+    state = PEER_PERIPHERAL;
+    BLEDevice::getScan()->stop();
+    Serial.println("Peer link: the peer connected, we are peripheral");
+}
+
+void PeerLink::onDisconnected() {
+    ready = false;
+    restart = true;
+    Serial.println("Peer link: disconnected");
+}
+
+void PeerLink::notified(BLERemoteCharacteristic *characteristic, uint8_t *data, size_t length, bool isNotify) {
+    if (length != sizeof(PeerPosition))
+        return;
+    PeerPosition position;
+    memcpy(&position, data, sizeof(position));
+    instance->received(position.x, position.y);
+}
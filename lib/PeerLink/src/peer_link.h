@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////
+// Symmetric peer link for the dual-role sketches (first and
+// second). Each device advertises the same peer service and
+// scans for it. The first to see the other compares Bluetooth
+// addresses: the lower one connects as central, the higher one
+// stops scanning and waits. Both run the same code, and there
+// is only one connection to make and keep.
+//
+// Positions go both ways over the link's one characteristic.
+// The central writes without response; the peripheral notifies.
+// After a disconnect both sides advertise and scan again, and
+// the election runs again.
+//
+// One instance per sketch (the notify callback finds it through
+// a static). The BLE callbacks run on the BLE task; connecting
+// blocks, so it happens in update(), from loop().
+///////////////////////////////////////////////////////////////
+#ifndef PEER_LINK_H
+#define PEER_LINK_H
+
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+
+#define PEER_SERVICE_UUID "7d27c938-0d08-499b-8cd4-f421c2064c30"
+#define PEER_POSITION_CHARACTERISTIC_UUID "16418f16-9f91-49b3-94e5-443f79fbca21"
+#define PEER_SCAN_SECONDS 5         // scans run in bursts; update() starts the next one
+#define PEER_WAIT_MS 10000          // lost the election: wait this long for the winner, then scan again
+
+// Value of the position characteristic, in both directions
+struct __attribute__((packed)) PeerPosition {
+    int16_t x;
+    int16_t y;
+};
+
+enum PeerLinkState : uint8_t {
+    PEER_DISCOVERING,       // advertising and scanning
+    PEER_CONNECTING,        // won the election: update() connects
+    PEER_WAITING,           // lost it: advertising until the peer connects
+    PEER_CENTRAL,           // we connected; ready once subscribed to its notifications
+    PEER_PERIPHERAL,        // the peer connected; ready once it subscribes to ours
+};
+
+class PeerLink {
+public:
+    typedef void (*Receiver)(int x, int y);
+
+    // Starts BLE as `name` and begins discovery. `received` gets the peer's
+    // position, on the BLE task.
+    void begin(const char *name, Receiver received);
+
+    // Call from loop(): connects when we won the election, and restarts
+    // discovery after a disconnect or when the winner never showed up
+    void update();
+
+    // Our position to the peer (dropped until the link is ready)
+    void send(int x, int y);
+
+    bool connected() const { return ready; }
+    bool central() const { return state == PEER_CENTRAL; }
+
+private:
+    class ServerCallbacks;
+    class ClientCallbacks;
+    class CharacteristicCallbacks;
+    class CccdCallbacks;
+    class ScanCallbacks;
+
+    void discover();
+    void startScan();
+    void connect();
+    void onFound(BLEAdvertisedDevice &device);
+    void onPeerConnected();
+    void onDisconnected();
+    static void scanComplete(BLEScanResults results);
+    static void notified(BLERemoteCharacteristic *characteristic, uint8_t *data, size_t length, bool isNotify);
+
+    static PeerLink *instance;
+    Receiver received = nullptr;
+    BLECharacteristic *characteristic = nullptr;
+    BLEClient *client = nullptr;
+    BLERemoteCharacteristic *remote = nullptr;
+    volatile PeerLinkState state = PEER_DISCOVERING;
+    volatile bool ready = false;
+    volatile bool scanning = false;
+    volatile bool restart = false;      // disconnected (BLE task); update() rediscovers
+    esp_bd_addr_t peerAddress;
+    esp_ble_addr_type_t peerAddressType = BLE_ADDR_TYPE_PUBLIC;
+    unsigned long electedAt = 0;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "telemetry.h"
+
+void Telemetry::begin(HardwareSerial &serial, uint32_t baud, RecordRole role, RecordMode mode) {
+    if (serial.baudRate() != baud) {
+        Serial.printf("Telemetry: serial port at %u baud from now on\n", baud);
+        serial.flush();
+        serial.updateBaudRate(baud);
+    }
+    this->serial = &serial;
+    hello = { TELEMETRY_VERSION, role, mode };
+    send(TLM_HELLO, &hello, sizeof(hello));
+}
+
+void Telemetry::frame(uint32_t startUs, uint32_t networkUs, uint32_t gameUs, uint32_t renderUs, uint8_t screen) {
+    if (serial == nullptr)
+        return;
+    TelemetryFrame record = { startUs, clamp(framed ? startUs - lastFrameUs : 0), clamp(networkUs),
+                              clamp(gameUs), clamp(renderUs), screen };
+    lastFrameUs = startUs;
+    framed = true;
+    send(TLM_FRAME, &record, sizeof(record));
+}
+
+void Telemetry::stats(unsigned long intervalMs, uint32_t rttUs) {
+    if (serial == nullptr || millis() - lastStats < intervalMs)
+        return;
+    lastStats = millis();
+    TelemetryStats record = { (uint32_t)micros(), rttUs, ESP.getFreeHeap(), ESP.getMinFreeHeap(),
+                              ESP.getMaxAllocHeap(), (uint16_t)uxTaskGetStackHighWaterMark(NULL),
+                              droppedFrames };
+    send(TLM_HELLO, &hello, sizeof(hello));
+    send(TLM_STATS, &record, sizeof(record));
+}
+
+///////////////////////////////////////////////////////////////
+// Whole frames or nothing: a partial one would only cost the
+// host a CRC failure, but the wait for room is what we avoid
+///////////////////////////////////////////////////////////////
+void Telemetry::send(TelemetryType type, const void *payload, uint8_t length) {
+    uint8_t encoded[TELEMETRY_MAX_ENCODED];
+    size_t size = telemetryEncode(type, seq, payload, length, encoded);
+    if ((size_t)serial->availableForWrite() < size) {
+        droppedFrames++;
+        return;
+    }
+    serial->write(encoded, size);
+    seq++;
+}
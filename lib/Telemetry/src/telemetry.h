@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////
+// Telemetry: per-frame timings and per-second memory and RTT
+// stats as a binary stream on the serial port (format in
+// lib/GameCore/src/telemetry_stream.h, decoder in
+// tools/telemetry). A frame is written only if the UART has
+// room for all of it, so sending never blocks loop() and never
+// perturbs the timings it reports; frames that don't fit are
+// counted and the count goes out with the stats.
+//
+// Not thread-safe: call from loop() only. Every call is a
+// no-op until begin().
+///////////////////////////////////////////////////////////////
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <match_record.h>
+#include <telemetry_stream.h>
+
+class Telemetry {
+public:
+    // Starts the stream on `serial` (moving it to `baud` if it runs at another rate)
+    void begin(HardwareSerial &serial, uint32_t baud, RecordRole role, RecordMode mode);
+
+    // One loop() iteration that started at `startUs`
+    void frame(uint32_t startUs, uint32_t networkUs, uint32_t gameUs, uint32_t renderUs, uint8_t screen);
+
+    // Hello + stats every `intervalMs`; `rttUs` is 0 where it isn't measured
+    void stats(unsigned long intervalMs, uint32_t rttUs);
+
+    uint32_t dropped() const { return droppedFrames; }
+
+private:
+    void send(TelemetryType type, const void *payload, uint8_t length);
+    static uint16_t clamp(uint32_t us) { return us > 0xFFFF ? 0xFFFF : us; }
+
+    HardwareSerial *serial = nullptr;
+    TelemetryHello hello;
+    uint8_t seq = 0;
+    uint32_t lastFrameUs = 0;
+    bool framed = false;
+    unsigned long lastStats = 0;
+    uint32_t droppedFrames = 0;
+};
+
+#endif
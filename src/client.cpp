@@ -5,6 +5,16 @@
 #include <BLE2902.h>
 #include <M5Core2.h>
 #include <Adafruit_seesaw.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include <lockstep.h>
+#include <clock_sync.h>
+#include <latency.h>
+#include <write_queue.h>
+#include <match_recorder.h>
+#include <telemetry.h>
+#include <game_engine.h>
+#include "game_protocol.h"
 
 ///////////////////////////////////////////////////////////////
 // Variables
@@ -13,9 +23,8 @@ BLERemoteCharacteristic *bleReadXCharacteristic;
 BLERemoteCharacteristic *bleReadYCharacteristic;
 BLERemoteCharacteristic *bleReadWriteXCharacteristic;
 BLERemoteCharacteristic *bleReadWriteYCharacteristic;
-static BLEAdvertisedDevice *bleRemoteServer;
-static boolean doConnect = false;
-static boolean doScan = false;
+static BLEClient *bleClient = nullptr;
+static String bleRemoteServerName = "";
 bool deviceConnected = false;
 int timer = 0;
 
@@ -25,6 +34,232 @@ static BLEUUID READ_X_CHARACTERISTIC_UUID("563c64b2-9634-4f7a-9f4f-d9e3231faa56"
 static BLEUUID READ_Y_CHARACTERISTIC_UUID("aa88ac15-3e2b-4735-92ff-4c712173e9f3");
 static BLEUUID READ_WRITE_X_CHARACTERISTIC_UUID("1da468d6-993d-4387-9e71-1c826b10fff9");
 static BLEUUID READ_WRITE_Y_CHARACTERISTIC_UUID("cf7b4787-d412-4e69-8b61-e2cfba89ff19");
+static BLEUUID STATE_CHARACTERISTIC_UUID("0b8e2f5a-6c1d-4e3b-9a47-5d2c8f1e6a90");
+static BLEUUID CONTROL_CHARACTERISTIC_UUID("e4c1a7d2-58b3-4f0e-8d96-2a7b3c9e1f45");
+static BLEUUID LOCKSTEP_CHARACTERISTIC_UUID("7f3d9c2e-1b4a-4e6f-a8d5-3c9b2e7f1a64");
+static BLEUUID INPUT_CHARACTERISTIC_UUID("3a6e9b1d-7c4f-4a2e-b8d3-6f1e2c9a5b07");
+static BLEUUID CLOCK_CHARACTERISTIC_UUID("5e2b8c41-9d7a-4f36-b1e8-0c4a7d3f962b");
+static BLEUUID LATENCY_CHARACTERISTIC_UUID("c9a4e1f7-2d6b-4c8e-9f31-7b5a0d2e8c16");
+static BLEUUID LINK_STATS_CHARACTERISTIC_UUID("2f6c8d13-a4b7-4e59-b0c2-9d1e7a3f5c48");
+
+// Lockstep mode: instead of writing positions, both devices exchange only their
+// per-tick inputs and run the same simulation (lib/GameCore). Must match the server.
+#define LOCKSTEP_MODE 0
+
+// Authoritative mode: we only forward our inputs and draw the server's
+// simulation from its snapshots. Must match the server.
+#define AUTHORITATIVE_MODE 0
+
+// Match recording: inputs, positions and BLE events go to /clientNNN.rec on
+// LittleFS, or on the SD card when RECORD_TO_SD is set
+#define MATCH_RECORDING 0
+#define RECORD_TO_SD 0
+
+// Latency measurement: every move is stamped with the time its joystick sample
+// was taken and the receiver times the frame that draws it, so both directions
+// of input-to-photon latency end up in histograms (printed every
+// LATENCY_REPORT_MS). Needs the clock sync, and the server's LATENCY_MODE too.
+#define LATENCY_MODE 0
+#define LATENCY_REPORT_MS 10000
+
+// Task layout (lib/GameEngine/src/task_layout.h): BLE on core 0, loop() on
+// core 1. With RENDER_TASK, frames are drawn by a task of their own on core 1,
+// above loop() (which never blocks) and idle until a frame arrives; RENDER_DMA
+// has it push them in DMA strips and sleep through the transfers.
+// CORE_LOAD_REPORT logs both cores' load, and RENDER_REPORT the frame rates,
+// every CORE_LOAD_REPORT_MS.
+#define GAME_TASK_PRIORITY 1
+#define RENDER_TASK 0
+#define RENDER_TASK_PRIORITY 2
+#define RENDER_DMA 0
+#define CORE_LOAD_REPORT 0
+#define RENDER_REPORT 0
+#define CORE_LOAD_REPORT_MS 5000
+
+// Telemetry (lib/Telemetry): a binary stream of per-frame stage timings and
+// per-second RTT and memory stats on the USB serial port, for tools/telemetry
+// to turn into CSV or a live dashboard. Text logging carries on alongside (the
+// decoder shows it as log lines), except the per-notify lines printed on the
+// BLE task (EVENT_LOG), which would crowd the frames out of the UART and split
+// them mid-frame; TELEMETRY_BAUD can raise the port's rate.
+#define TELEMETRY 0
+#define TELEMETRY_BAUD 115200
+#define TELEMETRY_STATS_MS 1000
+#define EVENT_LOG (!TELEMETRY)
+
+#if LATENCY_MODE && (LOCKSTEP_MODE || AUTHORITATIVE_MODE)
+#error "LATENCY_MODE measures the default (position) mode"
+#endif
+#if LATENCY_MODE && RENDER_TASK
+#error "LATENCY_MODE times frames drawn inside loop(), not on the render task"
+#endif
+#if RENDER_DMA && !RENDER_TASK
+#error "RENDER_DMA needs RENDER_TASK"
+#endif
+#if RENDER_DMA && MATCH_RECORDING && RECORD_TO_SD
+#error "The SD card shares the LCD's SPI bus, which RENDER_DMA holds for a whole frame"
+#endif
+
+// Peer cache: the server's address and attribute handles, so a reconnect can
+// skip both the scan and GATT discovery. Kept in RAM and (optionally) in NVS.
+#define PEER_CACHE_NVS 1
+#define PEER_CACHE_MAGIC 0x50434339
+#define PEER_CACHE_VALIDATE_MS 500
+struct PeerCache {
+    uint32_t magic;
+    esp_bd_addr_t address;
+    uint8_t addressType;
+    uint16_t readXHandle;
+    uint16_t readYHandle;
+    uint16_t readXCccdHandle;
+    uint16_t readYCccdHandle;
+    uint16_t readWriteXHandle;
+    uint16_t readWriteYHandle;
+    uint16_t stateHandle;
+    uint16_t stateCccdHandle;
+    uint16_t controlHandle;
+    uint16_t lockstepHandle;
+    uint16_t lockstepCccdHandle;
+    uint16_t inputHandle;
+    uint16_t clockHandle;
+    uint16_t clockCccdHandle;
+    uint16_t latencyHandle;
+    uint16_t latencyCccdHandle;
+    uint16_t linkStatsHandle;
+    uint16_t linkStatsCccdHandle;
+};
+static PeerCache peerCache;
+static bool peerCacheValid = false;
+static bool peerAddressKnown = false;
+static bool peerCacheUnreachable = false;   // the cached server didn't answer; scan for it, keep the cache
+static SemaphoreHandle_t peerCacheReadDone = nullptr;
+static volatile bool peerCacheReadOk = false;
+Preferences preferences;
+
+// Outgoing writes (all without response) wait in a latest-wins queue until the
+// controller has a buffer for them, instead of piling up in the stack; see
+// flushPeerWrites(). Replaced and dropped values are logged.
+#define PEER_WRITE_BURST 4          // most writes handed to the stack per flush
+#define PEER_WRITE_REPORT_MS 10000
+static WriteQueue peerWrites;
+static_assert(WRITE_QUEUE_MAX_VALUE >= sizeof("-2147483648") - 1, "positions are written as decimal strings");
+static_assert(WRITE_QUEUE_MAX_VALUE >= sizeof(ClockPing) && WRITE_QUEUE_MAX_VALUE >= sizeof(LatencyStamp) &&
+              WRITE_QUEUE_MAX_VALUE >= sizeof(LockstepPacket) && WRITE_QUEUE_MAX_VALUE >= sizeof(InputBatch),
+              "every packet the client writes must fit a WriteQueue slot");
+static_assert(WRITE_QUEUE_MAX_VALUE <= BLE_MAX_VALUE, "a queued value must fit one write at BLE_MTU");
+static volatile bool peerCongested = false;
+static uint32_t peerWritesSent = 0;
+static uint32_t reportedWriteLosses = 0;
+static unsigned long lastWriteReport = 0;
+
+// Link health view, toggled with BtnB during a match (the game keeps running
+// underneath, just not drawn): the server's ServerLinkStats next to our own
+// write queue and clock sync figures
+#define LINK_HEALTH_REFRESH_MS 250
+static ServerLinkStats serverLinkStats;
+static volatile bool serverLinkStatsValid = false;
+static portMUX_TYPE serverLinkStatsMux = portMUX_INITIALIZER_UNLOCKED;
+static bool linkHealthShown = false;
+static unsigned long lastLinkHealth = 0;
+
+// Match session, resumed from the server's snapshot on every (re)connect
+static uint32_t matchSessionId = 0;
+static unsigned long matchStartTime = 0;
+static bool rematchStartHeld = false;     // START was down when the game ended (see pollRematch)
+static MatchSnapshot peerSnapshot;
+static volatile bool peerSnapshotPending = false;
+static portMUX_TYPE peerSnapshotMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Lockstep simulation and the server inputs received on the BLE task. The
+// simulation is taken from the first snapshot of each connection (or of each
+// new match) only; later snapshots of the same match are behind it.
+static LockstepSession lockstep(false);
+static QueueHandle_t lockstepInbox;
+static unsigned long lastTickTime = 0;
+static bool lockstepSynced = false;
+
+// Clock sync with the server: pings go out from loop(), the replies are stamped
+// on arrival by the BLE task and queued. Quick pings until the estimate has a
+// full window, then one every couple of seconds. Kept across reconnects (the
+// server's clock keeps running); a server reboot is detected by ClockSync.
+#define CLOCK_FAST_INTERVAL_MS 200
+#define CLOCK_INTERVAL_MS 2000
+struct ClockReply {
+    ClockPong pong;
+    uint32_t receivedUs;
+};
+static ClockSync peerClock;
+static QueueHandle_t clockInbox;
+static uint16_t clockSeq = 0;
+static unsigned long lastClockPing = 0;
+
+// Latency measurement: our moves' stamps go out with the positions (the server
+// keeps that direction's histogram); the server's newest stamp waits here until
+// loop() hands it to serverMoves, which knows when each of its positions was
+// first drawn
+static LatencyHistogram serverToClient;
+static LatencyMatcher serverMoves;
+static LatencyStamp serverStamp;
+static volatile bool serverStampPending = false;
+static portMUX_TYPE serverStampMux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t latencySeq = 0;
+static unsigned long lastLatencyReport = 0;
+
+// Input samples not yet acknowledged by a later batch, oldest first
+static uint8_t inputHistory[INPUT_BATCH_SIZE];
+static uint16_t inputSeq = 0;
+
+// Per-core load (a no-op unless CORE_LOAD_REPORT)
+static CoreLoad coreLoad;
+
+// Recorder (a no-op unless MATCH_RECORDING) and the last position it logged
+static MatchRecorder recorder;
+static int recordedPosition[4] = { -1, -1, -1, -1 };
+
+// Telemetry stream (a no-op unless TELEMETRY)
+static Telemetry telemetry;
+
+// Scanning is driven directly through the GAP API so the controller can do the
+// filtering (duplicate filter, whitelist of the known server) instead of the host
+// seeing every advertisement in range. The schedule starts with a continuous scan
+// and backs off to the old 1349/449 ms duty cycle. Units are 0.625 ms.
+struct ScanPhase {
+    uint16_t interval;
+    uint16_t window;
+    unsigned long durationMs;
+};
+static const ScanPhase SCAN_SCHEDULE[] = {
+    { 0x0030, 0x0030, 3000 },   // 30 ms / 30 ms (100%) for 3 s
+    { 0x0100, 0x0050, 12000 },  // 160 ms / 50 ms (31%) for 12 s
+    { 0x086E, 0x02CE, 0 },      // 1349 ms / 449 ms (33%, long interval) until found
+};
+#define SCAN_PHASE_COUNT (sizeof(SCAN_SCHEDULE) / sizeof(SCAN_SCHEDULE[0]))
+#define SERVER_NAME "Duct Tape n' Prayer"
+static volatile bool scanning = false;
+static int scanPhase = 0;
+static bool scanWhitelisted = false;
+static unsigned long scanStartTime = 0;
+static unsigned long scanPhaseStartTime = 0;
+static volatile uint32_t scanReportCount = 0;
+
+// Connection management runs as an event-driven state machine so loop() never
+// blocks on the BLE stack. Blocking connect/discovery calls run in connectTask
+// and everything (BLE callbacks included) reports back through connEvents.
+enum ConnState { CONN_SCANNING, CONN_CONNECTING, CONN_DISCOVERING, CONN_SUBSCRIBED, CONN_BACKOFF };
+enum ConnEvent { EV_SERVER_FOUND, EV_CONNECTED, EV_DISCOVERED, EV_CONNECT_FAILED, EV_DISCONNECTED };
+#define BACKOFF_MIN_MS 250
+#define BACKOFF_MAX_MS 4000
+static ConnState connState = CONN_SCANNING;
+static QueueHandle_t connEvents;
+static TaskHandle_t connectTaskHandle;
+static unsigned long backoffMs = BACKOFF_MIN_MS;
+static unsigned long backoffUntil = 0;
+static bool wasSubscribed = false;
+
+// Time-to-discover metric
+static uint32_t discoverCount = 0;
+static unsigned long discoverTotalMs = 0;
+static unsigned long discoverBestMs = 0;
 
 // State
 enum Screen { S_GAME, S_GAME_OVER };
@@ -32,6 +267,7 @@ static Screen screen = S_GAME;
 
 // Gameplay Variables
 Adafruit_seesaw gamePad;
+StatusScreen status;
 
 #define BUTTON_SELECT    0
 #define BUTTON_START    16
@@ -47,16 +283,74 @@ int acceleration = 1;
 ///////////////////////////////////////////////////////////////
 // Forward Declarations
 ///////////////////////////////////////////////////////////////
-void drawScreenTextWithBackground(String text, int backgroundColor);
+void drawScreenTextWithBackground(String text, int backgroundColor, uint8_t textSize = STATUS_TEXT_SIZE);
+String peerName();
+
+// Peer cache
+bool loadPeerCache();
+void savePeerCache();
+void invalidatePeerCache();
+bool connectFromPeerCache();
+bool readPeerSnapshot();
+void subscribeToPeerCache();
+void writeToPeer(uint16_t handle, String value);
+void writeToPeer(uint16_t handle, uint8_t *data, size_t length);
+void flushPeerWrites();
+
+// Connection state machine
+void postConnEvent(ConnEvent event);
+void enterConnState(ConnState state);
+void handleConnEvent(ConnEvent event);
+void updateConnection();
+void connectTask(void *parameter);
+
+// Scanning
+void startScan();
+void updateScanSchedule();
+void applyScanPhase();
 
 // Gameplay
-void drawDots(uint32_t serverX, uint32_t serverY, uint32_t clientX, uint32_t clientY);
-void clientAccelIncrement();
-String milis_to_seconds(long milis);
-void playGame();
-void endGame();
-bool checkDistance();
-void warpDot();
+void enterGameOver();
+void pollRematch();
+bool applyPendingSnapshot();
+void playLockstep();
+void playForwarding(bool snapshotApplied);
+uint8_t readGamePadInput();
+void recordPosition();
+void syncClock();
+void drawLinkHealth();
+void writeLatencyStamp(int x, int y, uint32_t sampleUs);
+bool takeLatencyStamp(LatencyStamp &stamp);
+void measureLatency();
+
+// Last position written to the server, by moved() and warped() alike
+static int writtenX = -1, writtenY = -1;
+
+// The shared game, with our dot (client) on the joystick; each frame's move is
+// written to the server, one write per axis that changed
+struct ClientGame : ClientRole {
+    static void moved(int x, int y) {
+        uint32_t sampleUs = micros();   // the stick was read just before the move
+        if (x != writtenX)
+            writeToPeer(peerCache.readWriteXHandle, String(x));
+        if (y != writtenY)
+            writeToPeer(peerCache.readWriteYHandle, String(y));
+        writtenX = x;
+        writtenY = y;
+        if (LATENCY_MODE)
+            writeLatencyStamp(x, y, sampleUs);
+    }
+    static void warped(int x, int y) {
+        writeToPeer(peerCache.readWriteXHandle, String(x));
+        writeToPeer(peerCache.readWriteYHandle, String(y));
+        writtenX = x;
+        writtenY = y;
+    }
+    static void sampled(uint8_t input) {
+        recorder.input(SIDE_LOCAL, input);
+    }
+};
+GameEngine<ClientGame> game(gamePad, xClient, yClient, acceleration, xServer, yServer);
 
 ///////////////////////////////////////////////////////////////
 // BLE Client Callback Methods
@@ -64,22 +358,85 @@ void warpDot();
 // connected to NOTIFIES this client (or any client listening)
 // that it has changed the remote characteristic
 ///////////////////////////////////////////////////////////////
-static void notifyXCallback(BLERemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify)
+static void notifyXCallback(uint8_t *pData, size_t length)
 {
-    String characteristicUUID = pBLERemoteCharacteristic->getUUID().toString().c_str();
-    Serial.printf("Notify callback for characteristic %s of data length %d\n", pBLERemoteCharacteristic->getUUID().toString().c_str(), length);
-      xServer = (int32_t)(pData[3] << 24 | pData[2] << 16 | pData[1] << 8 | pData[0]);
-      Serial.printf("\tValue was: %i", xServer);
-      delay(10);
+    xServer = (int32_t)(pData[3] << 24 | pData[2] << 16 | pData[1] << 8 | pData[0]);
+    if (EVENT_LOG)
+        Serial.printf("Notify callback for X of data length %u\n\tValue was: %i\n", (unsigned)length, xServer);
 }
 
-static void notifyYCallback(BLERemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify)
+static void notifyYCallback(uint8_t *pData, size_t length)
 {
-    String characteristicUUID = pBLERemoteCharacteristic->getUUID().toString().c_str();
-    Serial.printf("Notify callback for characteristic %s of data length %d\n", pBLERemoteCharacteristic->getUUID().toString().c_str(), length);
-          yServer = (int32_t)(pData[3] << 24 | pData[2] << 16 | pData[1] << 8 | pData[0]);
-      Serial.printf("\tValue was: %i", yServer);
-      delay(10);
+    yServer = (int32_t)(pData[3] << 24 | pData[2] << 16 | pData[1] << 8 | pData[0]);
+    if (EVENT_LOG)
+        Serial.printf("Notify callback for Y of data length %u\n\tValue was: %i\n", (unsigned)length, yServer);
+}
+
+static void snapshotCallback(uint8_t *pData, size_t length)
+{
+    portENTER_CRITICAL(&peerSnapshotMux);
+    memcpy(&peerSnapshot, pData, sizeof(peerSnapshot));
+    peerSnapshotPending = true;
+    portEXIT_CRITICAL(&peerSnapshotMux);
+}
+
+///////////////////////////////////////////////////////////////
+// Raw GATT client event handler
+// Notifications and the cache validation read are matched by
+// attribute handle, so they work whether or not the BLE library
+// ran discovery on this connection.
+///////////////////////////////////////////////////////////////
+static void gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t *param)
+{
+    switch (event) {
+        case ESP_GATTC_NOTIFY_EVT: {
+            uint32_t receivedUs = micros();
+            if (!peerCacheValid || param->notify.value_len < 4)
+                break;
+            recorder.ble(BLE_RX, param->notify.handle, param->notify.value_len);
+            if (param->notify.handle == peerCache.clockHandle && param->notify.value_len == sizeof(ClockPong)) {
+                ClockReply reply;
+                memcpy(&reply.pong, param->notify.value, sizeof(reply.pong));
+                reply.receivedUs = receivedUs;
+                xQueueSend(clockInbox, &reply, 0);
+            }
+            else if (param->notify.handle == peerCache.latencyHandle && param->notify.value_len == sizeof(LatencyStamp)) {
+                portENTER_CRITICAL(&serverStampMux);
+                memcpy(&serverStamp, param->notify.value, sizeof(serverStamp));
+                serverStampPending = true;
+                portEXIT_CRITICAL(&serverStampMux);
+            }
+            else if (param->notify.handle == peerCache.linkStatsHandle && param->notify.value_len == sizeof(ServerLinkStats)) {
+                portENTER_CRITICAL(&serverLinkStatsMux);
+                memcpy(&serverLinkStats, param->notify.value, sizeof(serverLinkStats));
+                serverLinkStatsValid = true;
+                portEXIT_CRITICAL(&serverLinkStatsMux);
+            }
+            else if (param->notify.handle == peerCache.stateHandle && param->notify.value_len == sizeof(MatchSnapshot))
+                snapshotCallback(param->notify.value, param->notify.value_len);
+            else if (param->notify.handle == peerCache.lockstepHandle && param->notify.value_len == sizeof(LockstepPacket))
+                xQueueSend(lockstepInbox, param->notify.value, 0);
+            else if (param->notify.handle == peerCache.readXHandle)
+                notifyXCallback(param->notify.value, param->notify.value_len);
+            else if (param->notify.handle == peerCache.readYHandle)
+                notifyYCallback(param->notify.value, param->notify.value_len);
+            break;
+        }
+        case ESP_GATTC_CONGEST_EVT:
+            // L2CAP is out of buffers for this link (or has room again)
+            peerCongested = param->congest.congested;
+            break;
+        case ESP_GATTC_READ_CHAR_EVT:
+            if (param->read.handle != peerCache.stateHandle)
+                break;
+            peerCacheReadOk = param->read.status == ESP_GATT_OK && param->read.value_len == sizeof(MatchSnapshot);
+            if (peerCacheReadOk)
+                snapshotCallback(param->read.value, param->read.value_len);
+            xSemaphoreGive(peerCacheReadDone);
+            break;
+        default:
+            break;
+    }
 }
 
 ///////////////////////////////////////////////////////////////
@@ -99,6 +456,7 @@ class MyClientCallback : public BLEClientCallbacks
     {
         deviceConnected = false;
         Serial.println("Device disconnected...");
+        postConnEvent(EV_DISCONNECTED);
     }
 };
 
@@ -107,16 +465,35 @@ class MyClientCallback : public BLEClientCallbacks
 ///////////////////////////////////////////////////////////////
 bool connectToServer()
 {
-    // Create the client
-    Serial.printf("Forming a connection to %s\n", bleRemoteServer->getName().c_str());
-    BLEClient *bleClient = BLEDevice::createClient();
-    bleClient->setClientCallbacks(new MyClientCallback());
-    Serial.println("\tClient connected");
+    unsigned long connectStart = millis();
+
+    // Create the client once and reuse it for every reconnect
+    if (bleClient == nullptr) {
+        bleClient = BLEDevice::createClient();
+        bleClient->setClientCallbacks(new MyClientCallback());
+        Serial.println("\tClient created");
+    }
+
+    // Fast path: connect straight to the cached address and reuse the cached handles
+    if (peerCacheValid) {
+        Serial.printf("Reconnecting to cached server %s\n", peerName().c_str());
+        if (connectFromPeerCache()) {
+            Serial.printf("\tReconnected from cache in %lu ms\n", millis() - connectStart);
+            return true;
+        }
+        return false;
+    }
+    if (!peerAddressKnown)
+        return false;
 
     // Connect to the remote BLE Server.
-    if (!bleClient->connect(bleRemoteServer))
-        Serial.printf("FAILED to connect to server (%s)\n", bleRemoteServer->getName().c_str());
-    Serial.printf("\tConnected to server (%s)\n", bleRemoteServer->getName().c_str());
+    Serial.printf("Forming a connection to %s\n", peerName().c_str());
+    if (!bleClient->connect(BLEAddress(peerCache.address), (esp_ble_addr_type_t)peerCache.addressType)) {
+        Serial.printf("FAILED to connect to server (%s)\n", peerName().c_str());
+        return false;
+    }
+    Serial.printf("\tConnected to server (%s)\n", peerName().c_str());
+    postConnEvent(EV_CONNECTED);
 
     // Obtain a reference to the service we are after in the remote BLE server.
     BLERemoteService *bleRemoteService = bleClient->getService(SERVICE_UUID);
@@ -159,71 +536,551 @@ bool connectToServer()
         return false;
     }
     Serial.printf("\tFound our characteristic UUID: %s\n", READ_WRITE_Y_CHARACTERISTIC_UUID.toString().c_str());
-    
+
+    BLERemoteCharacteristic *bleStateCharacteristic = bleRemoteService->getCharacteristic(STATE_CHARACTERISTIC_UUID);
+    if (bleStateCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", STATE_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", STATE_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleControlCharacteristic = bleRemoteService->getCharacteristic(CONTROL_CHARACTERISTIC_UUID);
+    if (bleControlCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", CONTROL_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", CONTROL_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleLockstepCharacteristic = bleRemoteService->getCharacteristic(LOCKSTEP_CHARACTERISTIC_UUID);
+    if (bleLockstepCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", LOCKSTEP_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", LOCKSTEP_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleInputCharacteristic = bleRemoteService->getCharacteristic(INPUT_CHARACTERISTIC_UUID);
+    if (bleInputCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", INPUT_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", INPUT_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleClockCharacteristic = bleRemoteService->getCharacteristic(CLOCK_CHARACTERISTIC_UUID);
+    if (bleClockCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", CLOCK_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", CLOCK_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleLatencyCharacteristic = bleRemoteService->getCharacteristic(LATENCY_CHARACTERISTIC_UUID);
+    if (bleLatencyCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", LATENCY_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", LATENCY_CHARACTERISTIC_UUID.toString().c_str());
+
+    BLERemoteCharacteristic *bleLinkStatsCharacteristic = bleRemoteService->getCharacteristic(LINK_STATS_CHARACTERISTIC_UUID);
+    if (bleLinkStatsCharacteristic == nullptr) {
+        Serial.printf("Failed to find our characteristic UUID: %s\n", LINK_STATS_CHARACTERISTIC_UUID.toString().c_str());
+        bleClient->disconnect();
+        return false;
+    }
+    Serial.printf("\tFound our characteristic UUID: %s\n", LINK_STATS_CHARACTERISTIC_UUID.toString().c_str());
+
+    // Remember the address and handles so the next reconnect can skip all of the above
+    BLERemoteDescriptor *readXCccd = bleReadXCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *readYCccd = bleReadYCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *stateCccd = bleStateCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *lockstepCccd = bleLockstepCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *clockCccd = bleClockCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *latencyCccd = bleLatencyCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    BLERemoteDescriptor *linkStatsCccd = bleLinkStatsCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    peerCache.magic = PEER_CACHE_MAGIC;
+    peerCache.readXHandle = bleReadXCharacteristic->getHandle();
+    peerCache.readYHandle = bleReadYCharacteristic->getHandle();
+    peerCache.readXCccdHandle = readXCccd != nullptr ? readXCccd->getHandle() : 0;
+    peerCache.readYCccdHandle = readYCccd != nullptr ? readYCccd->getHandle() : 0;
+    peerCache.readWriteXHandle = bleReadWriteXCharacteristic->getHandle();
+    peerCache.readWriteYHandle = bleReadWriteYCharacteristic->getHandle();
+    peerCache.stateHandle = bleStateCharacteristic->getHandle();
+    peerCache.stateCccdHandle = stateCccd != nullptr ? stateCccd->getHandle() : 0;
+    peerCache.controlHandle = bleControlCharacteristic->getHandle();
+    peerCache.lockstepHandle = bleLockstepCharacteristic->getHandle();
+    peerCache.lockstepCccdHandle = lockstepCccd != nullptr ? lockstepCccd->getHandle() : 0;
+    peerCache.inputHandle = bleInputCharacteristic->getHandle();
+    peerCache.clockHandle = bleClockCharacteristic->getHandle();
+    peerCache.clockCccdHandle = clockCccd != nullptr ? clockCccd->getHandle() : 0;
+    peerCache.latencyHandle = bleLatencyCharacteristic->getHandle();
+    peerCache.latencyCccdHandle = latencyCccd != nullptr ? latencyCccd->getHandle() : 0;
+    peerCache.linkStatsHandle = bleLinkStatsCharacteristic->getHandle();
+    peerCache.linkStatsCccdHandle = linkStatsCccd != nullptr ? linkStatsCccd->getHandle() : 0;
+    peerCacheValid = true;
+    savePeerCache();
+
+    // Pick up the match in progress
+    if (!readPeerSnapshot()) {
+        Serial.println("Failed to read the match snapshot");
+        bleClient->disconnect();
+        return false;
+    }
+
     // Check if server's characteristic can notify client of changes and register to listen if so
-    if (bleReadXCharacteristic->canNotify()) {
-      Serial.println("X can notify");
-      bleReadXCharacteristic->registerForNotify(notifyXCallback);
+    if (bleReadXCharacteristic->canNotify() && bleReadYCharacteristic->canNotify()) {
+      Serial.println("X and Y can notify");
+      subscribeToPeerCache();
+    }
+    Serial.printf("\tConnected with discovery in %lu ms\n", millis() - connectStart);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////
+// Connects to the cached server address and checks that the
+// cached handles still point at our characteristics by reading
+// the match snapshot (a stale handle fails or returns the wrong
+// size). Only stale handles drop the cache: a server that is
+// off, rebooting or out of range is scanned for, and the cache
+// is used again once the scan finds it.
+///////////////////////////////////////////////////////////////
+bool connectFromPeerCache()
+{
+    if (!bleClient->connect(BLEAddress(peerCache.address), (esp_ble_addr_type_t)peerCache.addressType)) {
+        Serial.println("\tFAILED to connect to cached server; scanning for it, cache kept");
+        peerCacheUnreachable = true;
+        return false;
     }
-    if (bleReadYCharacteristic->canNotify()) {
-      Serial.println("Y can notify");
-      bleReadYCharacteristic->registerForNotify(notifyYCallback);
+    postConnEvent(EV_CONNECTED);
+
+    if (!readPeerSnapshot()) {
+        Serial.println("\tCached handles are stale; falling back to a scan");
+        bleClient->disconnect();
+        invalidatePeerCache();
+        return false;
     }
+
+    subscribeToPeerCache();
     return true;
 }
 
+///////////////////////////////////////////////////////////////
+// Reads the match snapshot through its cached handle; the
+// result lands in gattcEventHandler
+///////////////////////////////////////////////////////////////
+bool readPeerSnapshot()
+{
+    peerCacheReadOk = false;
+    xSemaphoreTake(peerCacheReadDone, 0);
+    esp_err_t err = esp_ble_gattc_read_char(bleClient->getGattcIf(), bleClient->getConnId(),
+        peerCache.stateHandle, ESP_GATT_AUTH_REQ_NONE);
+    return err == ESP_OK && xSemaphoreTake(peerCacheReadDone, pdMS_TO_TICKS(PEER_CACHE_VALIDATE_MS)) == pdTRUE && peerCacheReadOk;
+}
+
+///////////////////////////////////////////////////////////////
+// Registers for notifications on the cached X/Y handles and
+// enables them on the server if it exposes a CCCD
+///////////////////////////////////////////////////////////////
+void subscribeToPeerCache()
+{
+    uint8_t enableNotify[] = {0x01, 0x00};
+    esp_gatt_if_t gattcIf = bleClient->getGattcIf();
+    uint16_t connId = bleClient->getConnId();
+
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.readXHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.readYHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.stateHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.lockstepHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.clockHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.latencyHandle);
+    esp_ble_gattc_register_for_notify(gattcIf, peerCache.address, peerCache.linkStatsHandle);
+    if (peerCache.readXCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.readXCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.readYCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.readYCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.stateCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.stateCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.lockstepCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.lockstepCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.clockCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.clockCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.latencyCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.latencyCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (peerCache.linkStatsCccdHandle != 0)
+        esp_ble_gattc_write_char_descr(gattcIf, connId, peerCache.linkStatsCccdHandle, sizeof(enableNotify),
+            enableNotify, ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+}
+
+///////////////////////////////////////////////////////////////
+// Writes a value (without response) to a cached peer handle
+///////////////////////////////////////////////////////////////
+void writeToPeer(uint16_t handle, String value)
+{
+    writeToPeer(handle, (uint8_t *)value.c_str(), value.length());
+}
+
+void writeToPeer(uint16_t handle, uint8_t *data, size_t length)
+{
+    if (bleClient == nullptr || !peerCacheValid)
+        return;
+    peerWrites.push(handle, data, length);
+    flushPeerWrites();
+}
+
+///////////////////////////////////////////////////////////////
+// Hands queued writes to the stack while the controller has
+// buffers for this connection and L2CAP isn't congested. The
+// count of free buffers only drops once the BLE task has taken
+// a write, so each flush sends a few at most. Call once per
+// loop() as well, to drain what had to wait.
+///////////////////////////////////////////////////////////////
+void flushPeerWrites()
+{
+    if (bleClient == nullptr || connState != CONN_SUBSCRIBED)
+        return;
+    uint16_t connId = bleClient->getConnId();
+    for (int burst = 0; burst < PEER_WRITE_BURST && !peerWrites.empty() && !peerCongested; burst++) {
+        if (esp_ble_get_cur_sendable_packets_num(connId) == 0)
+            break;
+        const WriteQueue::Entry &entry = peerWrites.front();
+        esp_ble_gattc_write_char(bleClient->getGattcIf(), connId, entry.handle, entry.length,
+            (uint8_t *)entry.value, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+        recorder.ble(BLE_TX, entry.handle, entry.length);
+        peerWritesSent++;
+        peerWrites.pop();
+    }
+
+    uint32_t losses = peerWrites.replaced() + peerWrites.dropped();
+    if (losses != reportedWriteLosses && millis() - lastWriteReport >= PEER_WRITE_REPORT_MS) {
+        lastWriteReport = millis();
+        reportedWriteLosses = losses;
+        Serial.printf("Peer writes: %lu sent, %lu replaced before sending, %lu dropped\n",
+                      (unsigned long)peerWritesSent, (unsigned long)peerWrites.replaced(),
+                      (unsigned long)peerWrites.dropped());
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// Peer cache persistence
+///////////////////////////////////////////////////////////////
+bool loadPeerCache()
+{
+#if PEER_CACHE_NVS
+    preferences.begin("peercache", true);
+    size_t length = preferences.getBytes("peer", &peerCache, sizeof(peerCache));
+    preferences.end();
+    peerCacheValid = length == sizeof(peerCache) && peerCache.magic == PEER_CACHE_MAGIC;
+    peerAddressKnown = peerCacheValid;
+#endif
+    return peerCacheValid;
+}
+
+void savePeerCache()
+{
+#if PEER_CACHE_NVS
+    preferences.begin("peercache", false);
+    preferences.putBytes("peer", &peerCache, sizeof(peerCache));
+    preferences.end();
+#endif
+}
+
+void invalidatePeerCache()
+{
+    // The address stays known (for the scan whitelist); only the handles are dropped
+    peerCacheValid = false;
+#if PEER_CACHE_NVS
+    preferences.begin("peercache", false);
+    preferences.remove("peer");
+    preferences.end();
+#endif
+}
+
+///////////////////////////////////////////////////////////////
+// Name of the server for on-screen messages; after a fast
+// reconnect there is no advertisement, only the cached address
+///////////////////////////////////////////////////////////////
+String peerName()
+{
+    if (bleRemoteServerName.length() > 0)
+        return bleRemoteServerName;
+    return String(BLEAddress(peerCache.address).toString().c_str());
+}
+
 ///////////////////////////////////////////////////////////////
 // Scan for BLE servers and find the first one that advertises
-// the service we are looking for.
+// the service we are looking for. Called from the BLE stack for
+// every GAP event; only reports the controller let through
+// reach the scan result case.
 ///////////////////////////////////////////////////////////////
-class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks
+static void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
-    /**
-     * Called for each advertising BLE server.
-     */
-    void onResult(BLEAdvertisedDevice advertisedDevice)
-    {
-        // Print device found
-        Serial.print("BLE Advertised Device found:");
-        Serial.printf("\tName: %s\n", advertisedDevice.getName().c_str());
-
-        if (advertisedDevice.haveServiceUUID() && 
-                advertisedDevice.isAdvertisingService(SERVICE_UUID) && 
-                advertisedDevice.getName() == "Duct Tape n' Prayer") {
-            BLEDevice::getScan()->stop();
-            bleRemoteServer = new BLEAdvertisedDevice(advertisedDevice);
-            doConnect = true;
-            doScan = true;
+    switch (event) {
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+            if (scanning)
+                esp_ble_gap_start_scanning(0);
+            break;
+        case ESP_GAP_BLE_SCAN_RESULT_EVT: {
+            if (param->scan_rst.search_evt != ESP_GAP_SEARCH_INQ_RES_EVT || !scanning)
+                break;
+            scanReportCount++;
+
+            // Cheapest check first: our 128-bit service UUID (adv and scan response are contiguous)
+            uint8_t length = 0;
+            uint8_t *uuid = esp_ble_resolve_adv_data(param->scan_rst.ble_adv, ESP_BLE_AD_TYPE_128SRV_CMPL, &length);
+            if (uuid == nullptr || length != 16 || !BLEUUID(uuid, 16, false).equals(SERVICE_UUID))
+                break;
+
+            // A whitelisted scan already knows who it is talking to; otherwise wait for the name
+            if (!scanWhitelisted) {
+                uint8_t *name = esp_ble_resolve_adv_data(param->scan_rst.ble_adv, ESP_BLE_AD_TYPE_NAME_CMPL, &length);
+                if (name == nullptr || length != strlen(SERVER_NAME) || memcmp(name, SERVER_NAME, length) != 0)
+                    break;
+            }
+
+            scanning = false;
+            esp_ble_gap_stop_scanning();
+            memcpy(peerCache.address, param->scan_rst.bda, sizeof(esp_bd_addr_t));
+            peerCache.addressType = param->scan_rst.ble_addr_type;
+            peerAddressKnown = true;
+            bleRemoteServerName = SERVER_NAME;
+
+            unsigned long discoverMs = millis() - scanStartTime;
+            discoverCount++;
+            discoverTotalMs += discoverMs;
+            if (discoverBestMs == 0 || discoverMs < discoverBestMs)
+                discoverBestMs = discoverMs;
+            Serial.printf("Discovered %s in %lu ms (phase %d, %u reports, avg %lu ms, best %lu ms)\n",
+                SERVER_NAME, discoverMs, scanPhase, scanReportCount, discoverTotalMs / discoverCount, discoverBestMs);
+            postConnEvent(EV_SERVER_FOUND);
+            break;
         }
+        default:
+            break;
+    }
+}
 
-    }     
-};
+///////////////////////////////////////////////////////////////
+// Starts the scan schedule from its most aggressive phase. If we
+// have seen the server before, the controller only reports it
+///////////////////////////////////////////////////////////////
+void startScan()
+{
+    scanPhase = 0;
+    scanReportCount = 0;
+    scanStartTime = millis();
+    scanWhitelisted = peerAddressKnown;
+    if (scanWhitelisted)
+        BLEDevice::whiteListAdd(BLEAddress(peerCache.address));
+    scanning = true;
+    applyScanPhase();
+}
 
+///////////////////////////////////////////////////////////////
+// Backs the scan off to the next phase once the current one
+// has run its course. Call from loop() while scanning
+///////////////////////////////////////////////////////////////
+void updateScanSchedule()
+{
+    const ScanPhase &phase = SCAN_SCHEDULE[scanPhase];
+    if (!scanning || phase.durationMs == 0 || millis() - scanPhaseStartTime < phase.durationMs)
+        return;
+
+    scanPhase++;
+    // The relaxed phase also accepts a different server, in case ours was replaced
+    if (SCAN_SCHEDULE[scanPhase].durationMs == 0 && scanWhitelisted) {
+        scanWhitelisted = false;
+        BLEDevice::whiteListRemove(BLEAddress(peerCache.address));
+    }
+    esp_ble_gap_stop_scanning();
+    applyScanPhase();
+}
+
+void applyScanPhase()
+{
+    const ScanPhase &phase = SCAN_SCHEDULE[scanPhase];
+    esp_ble_scan_params_t scanParams = {
+        .scan_type = scanWhitelisted ? BLE_SCAN_TYPE_PASSIVE : BLE_SCAN_TYPE_ACTIVE,
+        .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+        .scan_filter_policy = scanWhitelisted ? BLE_SCAN_FILTER_ALLOW_ONLY_WLST : BLE_SCAN_FILTER_ALLOW_ALL,
+        .scan_interval = phase.interval,
+        .scan_window = phase.window,
+        .scan_duplicate = BLE_SCAN_DUPLICATE_ENABLE
+    };
+    scanPhaseStartTime = millis();
+    Serial.printf("Scan phase %d: interval %u, window %u%s\n", scanPhase, phase.interval, phase.window,
+        scanWhitelisted ? " (whitelist)" : "");
+    // Scanning (re)starts from gapEventHandler once the parameters are applied
+    esp_ble_gap_set_scan_params(&scanParams);
+}
+
+///////////////////////////////////////////////////////////////
+// Connection state machine
+///////////////////////////////////////////////////////////////
+void postConnEvent(ConnEvent event)
+{
+    xQueueSend(connEvents, &event, 0);
+}
+
+///////////////////////////////////////////////////////////////
+// Entering a state starts its work and draws its status screen
+// once; nothing here blocks
+///////////////////////////////////////////////////////////////
+void enterConnState(ConnState state)
+{
+    connState = state;
+    switch (state) {
+        case CONN_SCANNING:
+            drawScreenTextWithBackground(wasSubscribed ? "Disconnected....re-scanning for BLE server..." : "Scanning for BLE server...",
+                wasSubscribed ? TFT_ORANGE : TFT_BLUE);
+            startScan();
+            break;
+        case CONN_CONNECTING:
+            drawScreenTextWithBackground((peerCacheValid ? "Reconnecting to BLE server: " : "Connecting to BLE server: ") + peerName(),
+                wasSubscribed ? TFT_ORANGE : TFT_BLUE);
+            xTaskNotifyGive(connectTaskHandle);
+            break;
+        case CONN_DISCOVERING:
+            drawScreenTextWithBackground("Connected to BLE server: " + peerName(), TFT_GREEN);
+            break;
+        case CONN_SUBSCRIBED: {
+            Serial.println("We are now connected to the BLE Server.");
+            wasSubscribed = true;
+            backoffMs = BACKOFF_MIN_MS;
+            lockstepSynced = false;
+            memset(inputHistory, 0, sizeof(inputHistory));
+            inputSeq = 0;
+            // The connection screens replaced the result; a snapshot that ends
+            // the match now draws it itself
+            bool wasOver = screen == S_GAME_OVER;
+            applyPendingSnapshot();
+            if (wasOver && screen == S_GAME_OVER)
+                game.endGame(timer);
+            writeToPeer(peerCache.readWriteXHandle, String(xClient));
+            writeToPeer(peerCache.readWriteYHandle, String(yClient));
+            break;
+        }
+        case CONN_BACKOFF:
+            Serial.printf("We have failed to connect to the server; retrying in %lu ms\n", backoffMs);
+            drawScreenTextWithBackground("FAILED to connect to BLE server: " + peerName(), TFT_RED);
+            backoffUntil = millis() + backoffMs;
+            backoffMs = min(backoffMs * 2, (unsigned long)BACKOFF_MAX_MS);
+            break;
+    }
+}
+
+void handleConnEvent(ConnEvent event)
+{
+    if (event == EV_CONNECTED)
+        recorder.ble(BLE_CONNECTED);
+    else if (event == EV_DISCONNECTED)
+        recorder.ble(BLE_DISCONNECTED);
+    else if (event == EV_DISCOVERED)
+        recorder.ble(BLE_SUBSCRIBED);
+    switch (event) {
+        case EV_SERVER_FOUND:
+            peerCacheUnreachable = false;
+            if (connState == CONN_SCANNING)
+                enterConnState(CONN_CONNECTING);
+            break;
+        case EV_CONNECTED:
+            if (connState == CONN_CONNECTING)
+                enterConnState(CONN_DISCOVERING);
+            break;
+        case EV_DISCOVERED:
+            if (connState == CONN_DISCOVERING)
+                enterConnState(CONN_SUBSCRIBED);
+            break;
+        case EV_CONNECT_FAILED:
+            if (connState == CONN_CONNECTING || connState == CONN_DISCOVERING)
+                enterConnState(CONN_BACKOFF);
+            break;
+        case EV_DISCONNECTED:
+            // Unsent values are stale by the time we are back; the new link starts uncongested
+            peerWrites.clear();
+            peerCongested = false;
+            serverLinkStatsValid = false;
+            // Disconnects during connect/discovery are reported by connectTask as a failure
+            if (connState == CONN_SUBSCRIBED)
+                enterConnState(peerCacheValid ? CONN_CONNECTING : CONN_SCANNING);
+            break;
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// Drains pending connection events and runs the timed parts of
+// the current state. Call once per loop()
+///////////////////////////////////////////////////////////////
+void updateConnection()
+{
+    ConnEvent event;
+    while (xQueueReceive(connEvents, &event, 0) == pdTRUE)
+        handleConnEvent(event);
+
+    if (connState == CONN_SCANNING)
+        updateScanSchedule();
+    else if (connState == CONN_BACKOFF && (long)(millis() - backoffUntil) >= 0)
+        enterConnState(peerCacheValid && !peerCacheUnreachable ? CONN_CONNECTING : CONN_SCANNING);
+}
+
+///////////////////////////////////////////////////////////////
+// Runs the blocking connect + discovery off the loop task, one
+// attempt per notification from enterConnState(CONN_CONNECTING)
+///////////////////////////////////////////////////////////////
+void connectTask(void *parameter)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        postConnEvent(connectToServer() ? EV_DISCOVERED : EV_CONNECT_FAILED);
+    }
+}
 
 ///////////////////////////////////////////////////////////////
 // Put your setup code here, to run once
 ///////////////////////////////////////////////////////////////
 void setup()
 {
-    // Init device
+    // Init device, and the game's side of the task layout
     M5.begin();
+    setGameLoopPriority(GAME_TASK_PRIORITY);
+    if (RENDER_TASK)
+        game.startRenderTask(RENDER_TASK_PRIORITY, RENDER_DMA);
+    if (CORE_LOAD_REPORT)
+        coreLoad.begin();
+    RecordMode mode = LOCKSTEP_MODE ? MODE_LOCKSTEP : AUTHORITATIVE_MODE ? MODE_AUTHORITATIVE : MODE_POSITIONS;
+    if (MATCH_RECORDING) {
+        if (RECORD_TO_SD)
+            recorder.begin(SD, "client", ROLE_CLIENT, mode);
+        else if (LittleFS.begin(true))
+            recorder.begin(LittleFS, "client", ROLE_CLIENT, mode);
+    }
+    if (TELEMETRY)
+        telemetry.begin(Serial, TELEMETRY_BAUD, ROLE_CLIENT, mode);
     M5.Lcd.setTextSize(3);
 
     // Init M5Core2 as a BLE Client
     Serial.print("Starting BLE...");
     String bleClientDeviceName = "";
     BLEDevice::init(bleClientDeviceName.c_str());
+    BLEDevice::setMTU(BLE_MTU);
+    peerCacheReadDone = xSemaphoreCreateBinary();
+    BLEDevice::setCustomGattcHandler(gattcEventHandler);
+    BLEDevice::setCustomGapHandler(gapEventHandler);
+    connEvents = xQueueCreate(8, sizeof(ConnEvent));
+    lockstepInbox = xQueueCreate(16, sizeof(LockstepPacket));
+    clockInbox = xQueueCreate(4, sizeof(ClockReply));
+    xTaskCreatePinnedToCore(connectTask, "bleConnect", 4096, NULL, 1, &connectTaskHandle, CORE_BLE);
 
-    // Retrieve a Scanner and set the callback we want to use to be informed when we
-    // have detected a new device.  Specify that we want active scanning and start the
-    // scan to run for 5 seconds.
-    BLEScan *pBLEScan = BLEDevice::getScan();
-    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-    pBLEScan->setInterval(1349);
-    pBLEScan->setWindow(449);
-    pBLEScan->setActiveScan(true);
-    pBLEScan->start(0, false);
-    drawScreenTextWithBackground("Scanning for BLE server...", TFT_BLUE);
+    // Known server: skip the scan and go straight to a cached reconnect
+    enterConnState(loadPeerCache() ? CONN_CONNECTING : CONN_SCANNING);
     
     // Gameplay setup
     if(!gamePad.begin(0x50)){
@@ -232,6 +1089,7 @@ void setup()
     }
     gamePad.pinModeBulk(button_mask, INPUT_PULLUP);
     gamePad.setGPIOInterrupts(button_mask, 1);
+    game.calibrate();
 }
 
 ///////////////////////////////////////////////////////////////
@@ -239,167 +1097,343 @@ void setup()
 ///////////////////////////////////////////////////////////////
 void loop()
 {
+    uint32_t loopStartUs = micros();
     M5.update();
-    
-    // If the flag "doConnect" is true then we have scanned for and found the desired
-    // BLE Server with which we wish to connect.  Now we connect to it.  Once we are
-    // connected we set the connected flag to be false.
-    if (doConnect == true)
-    {
-        if (connectToServer()) {
-            Serial.println("We are now connected to the BLE Server.");
-            drawScreenTextWithBackground("Connected to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
-            String x = String(xClient);
-            bleReadWriteXCharacteristic->writeValue(x.c_str(), false);
-            String y = String(yClient);
-            bleReadWriteYCharacteristic->writeValue(y.c_str(), false);
-            doConnect = false;
-            delay(3000);
-        }
-        else {
-            Serial.println("We have failed to connect to the server; there is nothin more we will do.");
-            drawScreenTextWithBackground("FAILED to connect to BLE server: " + String(bleRemoteServer->getName().c_str()), TFT_GREEN);
-            delay(3000);
-        }
-    }
+    uint32_t networkStartUs = micros();
+    updateConnection();
+    flushPeerWrites();
+    uint32_t networkUs = micros() - networkStartUs;
+    if (CORE_LOAD_REPORT)
+        coreLoad.report(CORE_LOAD_REPORT_MS);
+    if (RENDER_REPORT)
+        game.reportRender(CORE_LOAD_REPORT_MS);
 
     // If we are connected to a peer BLE Server, update the characteristic each time we are reached
     // with the current time since boot.
-    if (deviceConnected)
+    if (connState == CONN_SUBSCRIBED)
     {
-        bool stillPlaying = checkDistance();
-          if (screen == S_GAME && stillPlaying) {
-            playGame();
+        networkStartUs = micros();
+        syncClock();
+        bool snapshotApplied = applyPendingSnapshot();
+        networkUs += micros() - networkStartUs;
+
+        uint32_t gameStartUs = micros();
+        if (M5.BtnB.wasPressed() && screen == S_GAME)
+            linkHealthShown = !linkHealthShown;
+        if (screen != S_GAME)
+            linkHealthShown = false;
+        game.hide(linkHealthShown);
+
+        if (screen == S_GAME_OVER) {
+            pollRematch();
+        } else if (LOCKSTEP_MODE) {
+            playLockstep();
+        } else if (AUTHORITATIVE_MODE) {
+            playForwarding(snapshotApplied);
         } else {
-            if (timer == 0) {
-            timer = millis();
-            }
-            endGame();
-            delay(50000);
+            // The server's view of the dots decides the collision: game over
+            // arrives in its snapshot, as in the other modes
+            game.play();
+            if (LATENCY_MODE)
+                measureLatency();
         }
+        // Not once this frame ended the match: the result screen is up
+        if (linkHealthShown && screen == S_GAME)
+            drawLinkHealth();
+        recordPosition();
+        telemetry.frame(loopStartUs, networkUs, micros() - gameStartUs, game.takeRenderUs(), screen);
     }
-    else if (doScan) {
-        drawScreenTextWithBackground("Disconnected....re-scanning for BLE server...", TFT_ORANGE);
-        BLEDevice::getScan()->start(0); // this is just example to start scan after disconnect, most likely there is better way to do it in arduino
+    telemetry.stats(TELEMETRY_STATS_MS, peerClock.synced() ? peerClock.roundTripUs() : 0);
+}
+
+///////////////////////////////////////////////////////////////
+// Link health view: the server's side of the link (its
+// ServerLinkStats notify) and ours. Rebuilt a few times a second; StatusScreen
+// only redraws the lines that changed.
+///////////////////////////////////////////////////////////////
+void drawLinkHealth() {
+    if (millis() - lastLinkHealth < LINK_HEALTH_REFRESH_MS)
+        return;
+    lastLinkHealth = millis();
+
+    ServerLinkStats stats;
+    bool haveStats = serverLinkStatsValid;
+    portENTER_CRITICAL(&serverLinkStatsMux);
+    stats = serverLinkStats;
+    portEXIT_CRITICAL(&serverLinkStatsMux);
+
+    String text = "LINK HEALTH (BtnB)\n";
+    if (haveStats) {
+        text += "Server: up " + String(stats.uptimeMs / 1000) + " s\n";
+        text += "  loop " + String(stats.loopHz) + " Hz\n";
+        text += "  tx " + String(stats.txBytesPerSecond) + " B/s rx " + String(stats.rxBytesPerSecond) + " B/s\n";
+        text += "  notifies " + String(stats.notifiesSent) + "\n";
+        text += "  writes " + String(stats.writesReceived) + "\n";
+        text += "  errors";
+        for (int i = 0; i < LINK_STATUS_ERRORS; i++)
+            text += " " + String(stats.statusErrors[i]);
+        text += "\n";
+    } else {
+        text += "Server: no stats yet\n";
     }
+    text += "Client:\n";
+    text += "  sent " + String(peerWritesSent) + "\n";
+    text += "  replaced " + String(peerWrites.replaced()) + " dropped " + String(peerWrites.dropped()) + "\n";
+    text += "  congested " + String(peerCongested ? "yes" : "no") + "\n";
+    if (peerClock.synced())
+        text += "  clock rtt " + String(peerClock.roundTripUs() / 1000.0, 1) + " ms";
+    else
+        text += "  clock not synced";
+    drawScreenTextWithBackground(text, TFT_NAVY, 2);
 }
 
 ///////////////////////////////////////////////////////////////
-// Colors the background and then writes the text on top
+// Logs the dots whenever either of them has moved
 ///////////////////////////////////////////////////////////////
-void drawScreenTextWithBackground(String text, int backgroundColor) {
-    M5.Lcd.fillScreen(backgroundColor);
-    M5.Lcd.setCursor(0,0);
-    M5.Lcd.println(text);
+void recordPosition() {
+    int position[4] = { xServer, yServer, xClient, yClient };
+    if (memcmp(position, recordedPosition, sizeof(position)) == 0)
+        return;
+    memcpy(recordedPosition, position, sizeof(position));
+    recorder.position(xServer, yServer, xClient, yClient);
 }
 
-String milis_to_seconds(long milis) {
-    unsigned long seconds = milis / 1000;
-    String secondStr = seconds < 10 ? "0" + String(seconds) : String(seconds);
-    unsigned long miliseconds = milis % 60;
-    String milisecondsStr = miliseconds < 10 ? "0" + String(miliseconds) : String(miliseconds);
-    return secondStr + "." + milisecondsStr + "s";
+///////////////////////////////////////////////////////////////
+// Feeds the server's clock replies to the estimator and pings
+// it again when due
+///////////////////////////////////////////////////////////////
+void syncClock() {
+    ClockReply reply;
+    while (xQueueReceive(clockInbox, &reply, 0) == pdTRUE) {
+        bool accepted = peerClock.addSample(reply.pong.clientSendUs, reply.pong.serverReceiveUs,
+                                            reply.pong.serverSendUs, reply.receivedUs);
+        if (accepted && (peerClock.samples() < CLOCK_SYNC_WINDOW || reply.pong.seq % 16 == 0))
+            Serial.printf("Clock: offset %ld us, rtt %lu us, error %lu us, drift %.1f +/- %.1f ppm\n",
+                          (long)(peerClock.toRemote(reply.receivedUs) - reply.receivedUs),
+                          (unsigned long)peerClock.roundTripUs(),
+                          (unsigned long)peerClock.errorUs(reply.receivedUs),
+                          peerClock.driftPpm(), peerClock.driftErrorPpm());
+    }
+
+    unsigned long interval = peerClock.samples() < CLOCK_SYNC_WINDOW ? CLOCK_FAST_INTERVAL_MS : CLOCK_INTERVAL_MS;
+    if (millis() - lastClockPing < interval)
+        return;
+    lastClockPing = millis();
+    ClockPing ping;
+    ping.seq = clockSeq++;
+    ping.clientSendUs = micros();
+    writeToPeer(peerCache.clockHandle, (uint8_t*)&ping, sizeof(ping));
+}
+
+///////////////////////////////////////////////////////////////
+// Latency measurement (LATENCY_MODE): stamps go out on the
+// server's timebase, so nothing is sent until the clock is
+// synced
+///////////////////////////////////////////////////////////////
+void writeLatencyStamp(int x, int y, uint32_t sampleUs) {
+    if (!peerClock.synced())
+        return;
+    LatencyStamp stamp = { latencySeq++, (int16_t)x, (int16_t)y, peerClock.toRemote(sampleUs) };
+    writeToPeer(peerCache.latencyHandle, (uint8_t*)&stamp, sizeof(stamp));
+}
+
+bool takeLatencyStamp(LatencyStamp &stamp) {
+    if (!serverStampPending)
+        return false;
+    portENTER_CRITICAL(&serverStampMux);
+    stamp = serverStamp;
+    serverStampPending = false;
+    portEXIT_CRITICAL(&serverStampMux);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////
+// Called right after each frame is drawn: notes where it drew
+// the server's dot, and times the server's move once the frame
+// that first showed its position is known (the stamp arrives
+// after the position, often a frame or more after it is drawn)
+///////////////////////////////////////////////////////////////
+void measureLatency() {
+    uint32_t drawnUs = micros();
+    if (!peerClock.synced())
+        return;
+    LatencyStamp stamp;
+    if (takeLatencyStamp(stamp))
+        serverMoves.expect(stamp.x, stamp.y, stamp.sampleUs);
+    serverMoves.drawn(xServer, yServer, peerClock.toRemote(drawnUs));
+    int32_t latencyUs;
+    if (serverMoves.take(latencyUs))
+        serverToClient.add(latencyUs);
+
+    if (millis() - lastLatencyReport < LATENCY_REPORT_MS)
+        return;
+    lastLatencyReport = millis();
+    serverToClient.print(Serial, "Latency server -> client");
+    Serial.printf("  (clock sync error bound %.1f ms)\n", peerClock.errorUs(drawnUs) / 1000.0);
+}
+
+///////////////////////////////////////////////////////////////
+// Colors the background and then writes the text on top (only
+// what changed since the last call, see StatusScreen)
+///////////////////////////////////////////////////////////////
+void drawScreenTextWithBackground(String text, int backgroundColor, uint8_t textSize) {
+    game.flushRender();
+    status.show(text, backgroundColor, textSize);
 }
 
-bool checkDistance() {
-  long distance = abs(sqrt(pow((xServer - xClient), 2) + pow((yServer - yClient), 2)));
-  if (distance <= 30) {
+///////////////////////////////////////////////////////////////
+// Adopts the server's match snapshot (positions, screen, clock)
+// if a new one arrived since the last call
+///////////////////////////////////////////////////////////////
+bool applyPendingSnapshot() {
+  if (!peerSnapshotPending)
     return false;
+  MatchSnapshot snapshot;
+  portENTER_CRITICAL(&peerSnapshotMux);
+  snapshot = peerSnapshot;
+  peerSnapshotPending = false;
+  portEXIT_CRITICAL(&peerSnapshotMux);
+
+  if (snapshot.sessionId != matchSessionId || !lockstepSynced)
+    Serial.printf("%s match %08x at %u ms\n", snapshot.sessionId == matchSessionId ? "Resuming" : "Joining",
+      snapshot.sessionId, snapshot.elapsedMs);
+  if (snapshot.sessionId != matchSessionId) {
+    // New match (first join or rematch): start from scratch
+    acceleration = 1;
+    timer = 0;
+  }
+  if (snapshot.sessionId != matchSessionId || !lockstepSynced) {
+    GameState state;
+    state.tick = snapshot.tick;
+    state.rng.state = snapshot.rngState;
+    state.server = { snapshot.xServer, snapshot.yServer, snapshot.serverAcceleration };
+    state.client = { snapshot.xClient, snapshot.yClient, snapshot.clientAcceleration };
+    state.over = snapshot.screen == S_GAME_OVER;
+    lockstep.restore(snapshot.sessionId, state);
+    lockstepSynced = true;
+  }
+  Screen previousScreen = screen;
+  uint32_t previousSessionId = matchSessionId;
+  matchSessionId = snapshot.sessionId;
+  matchStartTime = millis() - snapshot.elapsedMs;
+  if (peerClock.synced()) {
+    // Count the time the snapshot spent in flight (or waiting to be read)
+    int32_t ageUs = micros() - peerClock.toLocal(snapshot.serverTimeUs);
+    if (ageUs > 0)
+      matchStartTime -= ageUs / 1000;
+  }
+  xServer = snapshot.xServer;
+  yServer = snapshot.yServer;
+  xClient = snapshot.xClient;
+  yClient = snapshot.yClient;
+  screen = (Screen)snapshot.screen;
+  if (snapshot.sessionId != previousSessionId || screen != previousScreen)
+    recorder.match(matchSessionId, screen);
+  if (screen == S_GAME_OVER && previousScreen != S_GAME_OVER) {
+    rematchStartHeld = true;
+    timer = snapshot.elapsedMs;
+    game.endGame(timer);
   }
   return true;
 }
 
-void clientAccelIncrement() {
-  if (acceleration == 5) {
-    acceleration = 1;
-  } else {
-    acceleration++;
+///////////////////////////////////////////////////////////////
+// Game over is a state, not a pause: the result is drawn once
+// and loop() keeps servicing BLE while waiting for a rematch.
+// Lockstep ends the match here, on the tick both sides agree
+// on; otherwise the server's snapshot does (applyPendingSnapshot)
+///////////////////////////////////////////////////////////////
+void enterGameOver() {
+  screen = S_GAME_OVER;
+  rematchStartHeld = true;
+  timer = millis() - matchStartTime;
+  game.endGame(timer);
+  recorder.match(matchSessionId, screen);
+}
+
+///////////////////////////////////////////////////////////////
+// START/BtnA asks the server for a rematch; the server answers
+// with a new session snapshot that resets this side. START
+// counts when pressed, not while held (through the collision).
+///////////////////////////////////////////////////////////////
+void pollRematch() {
+  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
+  bool startDown = !(buttons & (1UL << BUTTON_START));
+  bool startPressed = startDown && !rematchStartHeld;
+  rematchStartHeld = startDown;
+  if (M5.BtnA.wasPressed() || startPressed) {
+    uint8_t command = CMD_REMATCH;
+    writeToPeer(peerCache.controlHandle, &command, sizeof(command));
   }
 }
 
-void endGame() {
-  M5.Lcd.fillScreen(TFT_MAGENTA);
-  M5.Lcd.setTextColor(TFT_BLACK);
-  M5.Lcd.setTextSize(3);
-  M5.Lcd.drawString("GAME OVER", M5.Lcd.width() / 4, M5.Lcd.height() / 2 - 30);
-  M5.Lcd.setTextSize(2);
-  M5.Lcd.drawString("YOU LASTED FOR", M5.Lcd.width() / 4, M5.Lcd.height() / 2);
-  M5.Lcd.drawString(milis_to_seconds(timer), M5.Lcd.width() / 4, M5.Lcd.height() - 100);
-}
-
-void drawDots(uint32_t serverX, uint32_t serverY, uint32_t clientX, uint32_t clientY){
-  M5.Lcd.drawPixel(serverX, serverY, TFT_BLUE);
-  M5.Lcd.drawPixel(clientX, clientY, TFT_RED);
-}
-
-void playGame() {
-  M5.Lcd.fillScreen(TFT_BLACK);
-  // Reverse x/y values to match joystick orientation
-  int x = 1023 - gamePad.analogRead(14);
-  int y = 1023 - gamePad.analogRead(15);
-
-  // Left & Right For Joystick
-  if (x > 600) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((xClient + 1) < 320) {
-        xClient++;
-        String x = String(xClient);
-        bleReadWriteXCharacteristic->writeValue(x.c_str(), false);
-      }
-    }
-  } else if (x < 500) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((xClient - 1) > 0) {
-        xClient--;
-        String x = String(xClient);
-        bleReadWriteXCharacteristic->writeValue(x.c_str(), false);
-      }
-    }
+///////////////////////////////////////////////////////////////
+// Lockstep replacement for game.play(): sample and send our input
+// once per tick, then simulate every tick both inputs are in
+///////////////////////////////////////////////////////////////
+void playLockstep() {
+  LockstepPacket packet;
+  while (xQueueReceive(lockstepInbox, &packet, 0) == pdTRUE) {
+    int added = lockstep.addRemoteInput(packet);
+    for (int i = added - 1; i >= 0; i--)
+      recorder.input(SIDE_REMOTE, packet.inputs[i]);
   }
 
-  if (y < 480) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((yClient + 1) < 240) {
-        yClient++;
-        String y = String(yClient);
-        bleReadWriteYCharacteristic->writeValue(y.c_str(), false);
-      }
-    }
-  } else if (y > 560) {
-    for (int i = 0; i < acceleration; i++) {
-      if ((yClient - 1) > 0) {
-        yClient--;
-        String y = String(yClient);
-        bleReadWriteYCharacteristic->writeValue(y.c_str(), false);
-      }
-    }
+  if (millis() - lastTickTime >= LOCKSTEP_TICK_MS) {
+    lastTickTime = millis();
+    lockstep.addLocalInput(readGamePadInput(), packet);
+    writeToPeer(peerCache.lockstepHandle, (uint8_t *)&packet, sizeof(packet));
   }
 
-  // For the gamepad buttons
-  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
-  if (! (buttons & (1UL << BUTTON_SELECT))) {
-    clientAccelIncrement();
-    Serial.print("Button Accel: "); Serial.print(acceleration);
-    delay(500);
+  if (lockstep.advance() == 0)
+    return;
+  xServer = lockstep.state.server.x;
+  yServer = lockstep.state.server.y;
+  xClient = lockstep.state.client.x;
+  yClient = lockstep.state.client.y;
+  acceleration = lockstep.state.client.acceleration;
+  if (lockstep.state.over) {
+    enterGameOver();
+    return;
   }
-  if (! (buttons & (1UL << BUTTON_START))) {
-    warpDot();
-    delay(500);
+  game.render();
+}
+
+///////////////////////////////////////////////////////////////
+// Authoritative replacement for game.play(): sample our input
+// once per tick and forward it in batches; the dots (and game
+// over) come from the server's snapshots
+///////////////////////////////////////////////////////////////
+void playForwarding(bool snapshotApplied) {
+  if (millis() - lastTickTime >= LOCKSTEP_TICK_MS) {
+    lastTickTime = millis();
+    memmove(inputHistory, inputHistory + 1, INPUT_BATCH_SIZE - 1);
+    inputHistory[INPUT_BATCH_SIZE - 1] = readGamePadInput();
+    inputSeq++;
+    if (inputSeq % INPUT_BATCH_TICKS == 0) {
+      InputBatch batch;
+      batch.seq = inputSeq;
+      memcpy(batch.inputs, inputHistory, INPUT_BATCH_SIZE);
+      writeToPeer(peerCache.inputHandle, (uint8_t *)&batch, sizeof(batch));
+    }
   }
 
-  drawDots(xServer, yServer, xClient, yClient); 
-}
-
-void warpDot() {
-  // create random ints for x and y and have the dot drawn there next
-  int randx = rand() % M5.Lcd.width();
-  int randy = rand() % M5.Lcd.height();
-  xClient = randx;
-  yClient = randy;
-  
-  String x = String(xClient);
-  String y = String(yClient);
-  bleReadWriteXCharacteristic->writeValue(x.c_str(), false); //x.length()
-  bleReadWriteYCharacteristic->writeValue(y.c_str(), false); //y.length()
-  drawDots(xServer, yServer, xClient, yClient);
-}
\ No newline at end of file
+  if (!snapshotApplied)
+    return;
+  game.render();
+}
+
+///////////////////////////////////////////////////////////////
+// Joystick and buttons as lockstep input bits, from the same
+// filtered stick as game.play()
+///////////////////////////////////////////////////////////////
+uint8_t readGamePadInput() {
+  game.joystick().read(gamePad);
+  uint32_t buttons = gamePad.digitalReadBulk(button_mask);
+  uint8_t input = game.joystick().direction();
+
+  if (!(buttons & (1UL << BUTTON_SELECT))) input |= IN_SELECT;
+  if (!(buttons & (1UL << BUTTON_START))) input |= IN_START;
+  recorder.input(SIDE_LOCAL, input);
+  return input;
+}
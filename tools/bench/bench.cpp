@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////
+// Host microbenchmarks for the game and protocol hot paths
+//
+//   pio run -e bench
+//   .pio/build/bench/program [filter]
+//
+// One line per benchmark: name, ns/op and heap allocations/op.
+// ns/op is the best of several timed runs, so numbers from two
+// commits on the same machine are comparable.
+//
+// Benchmarks under mirror/ are not the shipped code: they copy
+// sketch code that needs Arduino (String, the LCD), with
+// std::string standing in for String (both keep short strings
+// inline and allocate once they outgrow that). They only stay
+// comparable while the code they copy is unchanged; everything
+// else calls GameCore directly.
+///////////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <game_core.h>
+#include "game_protocol.h"
+
+///////////////////////////////////////////////////////////////
+// Allocation counting
+///////////////////////////////////////////////////////////////
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Keeps the compiler from optimising a result away
+template <typename T> static inline void keep(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+///////////////////////////////////////////////////////////////
+// Runner: grows the iteration count until a run takes ~50 ms,
+// then reports the fastest of five runs
+///////////////////////////////////////////////////////////////
+typedef void (*Kernel)(size_t iterations);
+static const char *filter = nullptr;
+
+static void bench(const char *name, Kernel kernel) {
+    if (filter != nullptr && strstr(name, filter) == nullptr)
+        return;
+    using Clock = std::chrono::steady_clock;
+    size_t iterations = 1000;
+    while (true) {
+        auto start = Clock::now();
+        kernel(iterations);
+        if (Clock::now() - start > std::chrono::milliseconds(50) || iterations > (1u << 30))
+            break;
+        iterations *= 2;
+    }
+    double best = 1e300;
+    size_t allocs = 0;
+    for (int run = 0; run < 5; run++) {
+        size_t before = allocations;
+        auto start = Clock::now();
+        kernel(iterations);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        allocs = allocations - before;
+        if (ns < best)
+            best = ns;
+    }
+    printf("%-32s %10.2f ns/op %8.2f allocs/op\n", name, best / iterations, (double)allocs / iterations);
+}
+
+///////////////////////////////////////////////////////////////
+// Inputs: a deterministic walk of dot positions
+///////////////////////////////////////////////////////////////
+static int16_t positions[1024][4];
+static std::string writtenValues[1024];
+
+static void makePositions() {
+    GameRng rng;
+    rng.seed(1);
+    for (auto &p : positions)
+        for (int i = 0; i < 4; i++)
+            p[i] = rng.next() % (i % 2 == 0 ? GAME_WIDTH : GAME_HEIGHT);
+    for (int i = 0; i < 1024; i++)
+        writtenValues[i] = std::to_string(positions[i][2]);
+}
+
+///////////////////////////////////////////////////////////////
+// Position encode/decode
+///////////////////////////////////////////////////////////////
+
+// Mirror of the client's X/Y notify decode: int32 little-endian
+static void decodeNotifyInt(size_t n) {
+    uint8_t data[4];
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t x = positions[i & 1023][0];
+        memcpy(data, &x, 4);
+        keep(data);
+        sum += (int32_t)(data[3] << 24 | data[2] << 16 | data[1] << 8 | data[0]);
+    }
+    keep(sum);
+}
+
+// Mirror of ClientGame::moved(): String(xClient) written per axis that changed
+static void encodeWriteString(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        std::string value = std::to_string(positions[i & 1023][2]);
+        keep(value.data());
+    }
+}
+
+// Mirror of the server's onWrite(): getValue() -> String -> toInt()
+static void decodeWriteString(size_t n) {
+    int sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        std::string value(writtenValues[i & 1023]);
+        std::string copy(value.c_str());
+        sum += atoi(copy.c_str());
+    }
+    keep(sum);
+}
+
+// MatchSnapshot / lockstep style binary encode+decode
+static void snapshotRoundTrip(size_t n) {
+    MatchSnapshot snapshot = {};
+    uint8_t wire[sizeof(MatchSnapshot)];
+    int sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        const int16_t *p = positions[i & 1023];
+        snapshot.xServer = p[0];
+        snapshot.yServer = p[1];
+        snapshot.xClient = p[2];
+        snapshot.yClient = p[3];
+        memcpy(wire, &snapshot, sizeof(wire));
+        keep(wire);
+        MatchSnapshot decoded;
+        memcpy(&decoded, wire, sizeof(decoded));
+        sum += decoded.xClient;
+    }
+    keep(sum);
+}
+
+///////////////////////////////////////////////////////////////
+// Collision: GameEngine::checkDistance() is dotsCollide()
+///////////////////////////////////////////////////////////////
+
+static void dotsCollideCore(size_t n) {
+    int hits = 0;
+    for (size_t i = 0; i < n; i++) {
+        const int16_t *p = positions[i & 1023];
+        hits += dotsCollide(p[0], p[1], p[2], p[3]);
+    }
+    keep(hits);
+}
+
+///////////////////////////////////////////////////////////////
+// Game over text
+///////////////////////////////////////////////////////////////
+
+// formatLasted(), behind GameEngine's milis_to_seconds() (which adds one String)
+static void formatLastedCore(size_t n) {
+    char text[24];
+    for (size_t i = 0; i < n; i++) {
+        formatLasted((long)(i * 7919 % 600000), text, sizeof(text));
+        keep(text);
+    }
+}
+
+///////////////////////////////////////////////////////////////
+// Movement
+///////////////////////////////////////////////////////////////
+static void gameStepCore(size_t n) {
+    static const uint8_t inputs[] = { IN_X_POS, IN_X_POS | IN_Y_POS, IN_Y_NEG, IN_X_NEG, 0, IN_SELECT, 0, IN_START };
+    GameState state;
+    gameReset(state, 1);
+    for (size_t i = 0; i < n; i++) {
+        gameStep(state, inputs[i & 7], inputs[(i >> 3) & 7]);
+        if (state.over)
+            gameReset(state, (uint32_t)i);
+    }
+    keep(state);
+}
+
+// GameEngine::play(): one frame of fixed-point motion for one dot
+static void motionStepCore(size_t n) {
+    static const uint8_t inputs[] = { IN_X_POS, IN_X_POS | IN_Y_POS, IN_Y_NEG, IN_X_NEG, 0, IN_Y_POS, 0, IN_X_NEG };
+    Motion motion;
+    motionReset(motion, 10, 120);
+    for (size_t i = 0; i < n; i++)
+        motionStep(motion, inputs[(i >> 4) & 7], 1 + (i >> 7) % MAX_ACCELERATION, 15 + (i & 15));
+    keep(motion);
+}
+
+///////////////////////////////////////////////////////////////
+// Rendering (mirrors): what a frame costs in pixels written to
+// a RAM framebuffer, for GameEngine's fillScreen() + two dots
+// against a diff that only erases and redraws the dots that
+// moved. The LCD transfer itself isn't modelled.
+///////////////////////////////////////////////////////////////
+static uint16_t frame[GAME_HEIGHT][GAME_WIDTH];
+
+static void renderFullFrame(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const int16_t *p = positions[i & 1023];
+        memset(frame, 0, sizeof(frame));
+        frame[p[1]][p[0]] = 0x001F;
+        frame[p[3]][p[2]] = 0xF800;
+        keep(frame);
+    }
+}
+
+static void renderDiff(size_t n) {
+    const int16_t *previous = positions[1023];
+    for (size_t i = 0; i < n; i++) {
+        const int16_t *p = positions[i & 1023];
+        if (p[0] != previous[0] || p[1] != previous[1]) {
+            frame[previous[1]][previous[0]] = 0;
+            frame[p[1]][p[0]] = 0x001F;
+        }
+        if (p[2] != previous[2] || p[3] != previous[3]) {
+            frame[previous[3]][previous[2]] = 0;
+            frame[p[3]][p[2]] = 0xF800;
+        }
+        previous = p;
+        keep(frame);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        filter = argv[1];
+    makePositions();
+
+    bench("mirror/position/decode_notify_int32", decodeNotifyInt);
+    bench("mirror/position/encode_write_string", encodeWriteString);
+    bench("mirror/position/decode_write_string", decodeWriteString);
+    bench("mirror/render/full_frame", renderFullFrame);
+    bench("mirror/render/diff", renderDiff);
+    bench("position/snapshot_roundtrip", snapshotRoundTrip);
+    bench("collision/dotsCollide", dotsCollideCore);
+    bench("text/formatLasted", formatLastedCore);
+    bench("move/gameStep", gameStepCore);
+    bench("move/motionStep", motionStepCore);
+    return 0;
+}
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////
+// Plays a lockstep match between a simulated server and client
+// over lib/LinkEmulator, faster than real time
+//
+//   pio run -e linksim
+//   .pio/build/linksim/program --latency 30 --jitter 20 --loss 50
+//
+// Reports how often each side stalled waiting for the other,
+// how far the simulation ran behind the wall clock, packet
+// delivery times, and whether the two simulations ever differ.
+// --outage-at/--outage-ms cut the link to exercise the
+// reconnect path (server resume + client restore from the
+// server's state, as the snapshot does on the devices).
+///////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <game_core.h>
+#include <lockstep.h>
+#include <link_emulator.h>
+
+struct Options {
+    LinkConfig link;
+    uint32_t ticks = 30000;
+    uint32_t outageAtTick = 0;
+    uint32_t outageMs = 0;
+};
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [--latency ms] [--jitter ms] [--loss permille] [--reorder permille]\n"
+        "          [--interval ms] [--per-event n] [--ticks n] [--seed n]\n"
+        "          [--outage-at tick --outage-ms ms]\n", name);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        const char *flag = argv[i];
+        double value = atof(argv[++i]);
+        if (!strcmp(flag, "--latency")) options.link.latencyUs = value * 1000;
+        else if (!strcmp(flag, "--jitter")) options.link.jitterUs = value * 1000;
+        else if (!strcmp(flag, "--loss")) options.link.lossPerMille = value;
+        else if (!strcmp(flag, "--reorder")) options.link.reorderPerMille = value;
+        else if (!strcmp(flag, "--interval")) options.link.connectionIntervalUs = value * 1000;
+        else if (!strcmp(flag, "--per-event")) options.link.packetsPerEvent = value;
+        else if (!strcmp(flag, "--seed")) options.link.seed = value;
+        else if (!strcmp(flag, "--ticks")) options.ticks = value;
+        else if (!strcmp(flag, "--outage-at")) options.outageAtTick = value;
+        else if (!strcmp(flag, "--outage-ms")) options.outageMs = value;
+        else usage(argv[0]);
+    }
+    return options;
+}
+
+static void printDistribution(const char *name, std::vector<double> samples, const char *unit) {
+    if (samples.empty()) {
+        printf("  %-22s no samples\n", name);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    auto pct = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))]; };
+    printf("  %-22s mean=%7.2f p50=%7.2f p99=%7.2f max=%7.2f %s\n", name, sum / samples.size(), pct(0.5),
+        pct(0.99), samples.back(), unit);
+}
+
+// A player that leans on the joystick and sometimes presses a button
+static uint8_t randomInput(GameRng &rng) {
+    static const uint8_t directions[] = { 0, IN_X_POS, IN_X_NEG, IN_Y_POS, IN_Y_NEG, IN_X_POS | IN_Y_NEG };
+    uint32_t r = rng.next();
+    uint8_t input = directions[(r >> 8) % 6];
+    if ((r & 0xff) < 2) input |= IN_SELECT;
+    if ((r & 0xff) == 2) input |= IN_START;
+    return input;
+}
+
+struct Side {
+    LockstepSession session;
+    LinkChannel *out;
+    GameRng player;
+    uint32_t stalledTicks = 0;      // wall ticks in which the simulation did not move
+    uint32_t lastTick = 0;
+    std::vector<double> behindTicks;
+
+    Side(bool isServer, LinkChannel *out, uint32_t seed) : session(isServer), out(out) { player.seed(seed); }
+
+    // `wallTick` counts from the start of the current match
+    void tick(uint64_t nowUs, uint32_t wallTick) {
+        LockstepPacket packet;
+        session.addLocalInput(randomInput(player), packet);
+        out->send(&packet, sizeof(packet), nowUs);
+        behindTicks.push_back((double)wallTick - session.state.tick);
+        if (session.state.tick == lastTick && !session.state.over)
+            stalledTicks++;
+        lastTick = session.state.tick;
+    }
+
+    void receive(LinkChannel &in, uint64_t nowUs, std::vector<double> &deliveryMs) {
+        LinkPacket packet;
+        while (in.receive(nowUs, packet)) {
+            deliveryMs.push_back((packet.arrivalUs - packet.sentUs) / 1000.0);
+            if (packet.data.size() == sizeof(LockstepPacket)) {
+                LockstepPacket lockstepPacket;
+                memcpy(&lockstepPacket, packet.data.data(), sizeof(lockstepPacket));
+                session.addRemoteInput(lockstepPacket);
+            }
+        }
+    }
+};
+
+static uint32_t hashState(const GameState &state) {
+    uint32_t h = 2166136261u;
+    auto mix = [&](uint32_t v) { h = (h ^ v) * 16777619u; };
+    mix(state.tick);
+    mix(state.rng.state);
+    mix(state.server.x); mix(state.server.y); mix(state.server.acceleration);
+    mix(state.client.x); mix(state.client.y); mix(state.client.acceleration);
+    return h;
+}
+
+int main(int argc, char **argv) {
+    Options options = parseOptions(argc, argv);
+    EmulatedLink link(options.link);
+    Side server(true, &link.toClient, options.link.seed + 100);
+    Side client(false, &link.toServer, options.link.seed + 200);
+
+    uint32_t seed = options.link.seed * 7919;
+    server.session.reset(seed);
+    client.session.reset(seed);
+
+    std::map<uint32_t, uint32_t> serverHashes;     // tick -> state hash, to compare with the client
+    std::vector<double> deliveryMs;
+    uint32_t compared = 0, desyncs = 0, matches = 1;
+    uint32_t matchStartTick = 0;
+    uint64_t outageStartUs = (uint64_t)options.outageAtTick * LOCKSTEP_TICK_MS * 1000;
+    uint64_t outageEndUs = outageStartUs + (uint64_t)options.outageMs * 1000;
+    bool hadOutage = false;
+
+    uint64_t endUs = (uint64_t)options.ticks * LOCKSTEP_TICK_MS * 1000;
+    for (uint64_t nowUs = 0; nowUs < endUs; nowUs += 1000) {
+        // Link outage, then the devices' reconnect: the server resumes and the
+        // client adopts the server's state from the snapshot
+        if (options.outageMs > 0 && !hadOutage && nowUs >= outageStartUs) {
+            link.setConnected(nowUs >= outageEndUs);
+            if (link.connected()) {
+                hadOutage = true;
+                server.session.resume();
+                client.session.restore(seed, server.session.state);
+            }
+        }
+
+        if (nowUs % (LOCKSTEP_TICK_MS * 1000) == 0) {
+            uint32_t wallTick = nowUs / (LOCKSTEP_TICK_MS * 1000) - matchStartTick;
+            server.tick(nowUs, wallTick);
+            client.tick(nowUs, wallTick);
+        }
+        server.receive(link.toServer, nowUs, deliveryMs);
+        client.receive(link.toClient, nowUs, deliveryMs);
+
+        if (server.session.advance() > 0)
+            serverHashes[server.session.state.tick] = hashState(server.session.state);
+        if (client.session.advance() > 0) {
+            auto expected = serverHashes.find(client.session.state.tick);
+            if (expected != serverHashes.end()) {
+                compared++;
+                if (expected->second != hashState(client.session.state))
+                    desyncs++;
+            }
+        }
+
+        // Keep playing through collisions: a new match on the same seed stream
+        if (server.session.state.over && client.session.state.over &&
+            server.session.state.tick == client.session.state.tick) {
+            seed = seed * 1103515245u + 12345u;
+            server.session.reset(seed);
+            client.session.reset(seed);
+            serverHashes.clear();
+            matches++;
+            matchStartTick = nowUs / (LOCKSTEP_TICK_MS * 1000);
+        }
+    }
+
+    printf("link: latency %.1f ms, jitter %.1f ms, loss %u/1000, reorder %u/1000, interval %.1f ms x %u\n",
+        options.link.latencyUs / 1000.0, options.link.jitterUs / 1000.0, options.link.lossPerMille,
+        options.link.reorderPerMille, options.link.connectionIntervalUs / 1000.0, options.link.packetsPerEvent);
+    printf("  %u wall ticks, %u matches, server at tick %u, client at tick %u\n", options.ticks, matches,
+        server.session.state.tick, client.session.state.tick);
+    printf("  packets: to client %u sent / %u dropped / %u reordered, to server %u / %u / %u\n",
+        link.toClient.stats.sent, link.toClient.stats.dropped, link.toClient.stats.reordered,
+        link.toServer.stats.sent, link.toServer.stats.dropped, link.toServer.stats.reordered);
+    printf("  stalled ticks: server %u, client %u\n", server.stalledTicks, client.stalledTicks);
+    printDistribution("delivery", deliveryMs, "ms");
+    printDistribution("server behind wall", server.behindTicks, "ticks");
+    printDistribution("client behind wall", client.behindTicks, "ticks");
+    printf("  %u ticks compared, %u desyncs\n", compared, desyncs);
+    return desyncs == 0 ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////
+// Load generator for the GATT server, host stand-in
+//
+//   pio run -e loadgen
+//   .pio/build/loadgen/program --clients 2 --rate 100
+//   .pio/build/loadgen/program --clients 1 --sweep
+//
+// N simulated clients write position updates over
+// lib/LinkEmulator to a model of the server's BLE task: one
+// queue, handled one event at a time, where each onWrite()
+// costs its handling plus the Serial.printf() it logs (the
+// UART drains at --baud), and each X/Y notify from loop()
+// takes its turn on the same task. Reports achieved write
+// throughput, dropped updates and write-to-handled latency.
+//
+// These are modelled numbers, not measurements: they follow
+// from --service-us and --log-bytes, whose defaults are
+// estimates that nothing on the device has timed. Measured
+// numbers come from the firmware load generator
+// (alternate_src_and_examples/loadgen_src), which times every
+// tenth write against a real server. Use this tool to ask
+// "what if" (another baud rate, no logging, more clients),
+// and trust it only after its knee lines up with the one the
+// firmware finds with the same settings.
+///////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <link_emulator.h>
+
+struct Options {
+    LinkConfig link;
+    uint32_t clients = 1;
+    double rate = 50;               // writes per second per client
+    uint32_t seconds = 10;
+    uint32_t serviceUs = 150;       // onWrite() without the logging
+    uint32_t logBytes = 70;         // "Client JUST wrote to <uuid>: <value>"
+    uint32_t baud = 115200;
+    uint32_t notifyRate = 50;       // X/Y notifies per second from loop()
+    uint32_t queueDepth = 32;       // BLE task event queue
+    bool sweep = false;
+    bool costsGiven = false;        // --service-us and --log-bytes both on the command line
+};
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [--clients n] [--rate writes/s] [--seconds n] [--sweep]\n"
+        "          [--service-us n] [--log-bytes n] [--baud n] [--notify-rate n] [--queue n]\n"
+        "          [--latency ms] [--jitter ms] [--loss permille] [--interval ms] [--per-event n]\n", name);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char **argv) {
+    Options options;
+    options.link.connectionIntervalUs = 7500;
+    options.link.packetsPerEvent = 6;
+    for (int i = 1; i < argc; i++) {
+        const char *flag = argv[i];
+        if (!strcmp(flag, "--sweep")) {
+            options.sweep = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        double value = atof(argv[++i]);
+        if (!strcmp(flag, "--clients")) options.clients = value;
+        else if (!strcmp(flag, "--rate")) options.rate = value;
+        else if (!strcmp(flag, "--seconds")) options.seconds = value;
+        else if (!strcmp(flag, "--service-us")) options.serviceUs = value;
+        else if (!strcmp(flag, "--log-bytes")) options.logBytes = value;
+        else if (!strcmp(flag, "--baud")) options.baud = value;
+        else if (!strcmp(flag, "--notify-rate")) options.notifyRate = value;
+        else if (!strcmp(flag, "--queue")) options.queueDepth = value;
+        else if (!strcmp(flag, "--latency")) options.link.latencyUs = value * 1000;
+        else if (!strcmp(flag, "--jitter")) options.link.jitterUs = value * 1000;
+        else if (!strcmp(flag, "--loss")) options.link.lossPerMille = value;
+        else if (!strcmp(flag, "--interval")) options.link.connectionIntervalUs = value * 1000;
+        else if (!strcmp(flag, "--per-event")) options.link.packetsPerEvent = value;
+        else usage(argv[0]);
+    }
+    if (options.clients == 0 || options.rate <= 0)
+        usage(argv[0]);
+    bool serviceGiven = false, logGiven = false;
+    for (int i = 1; i < argc; i++) {
+        serviceGiven |= !strcmp(argv[i], "--service-us");
+        logGiven |= !strcmp(argv[i], "--log-bytes");
+    }
+    options.costsGiven = serviceGiven && logGiven;
+    return options;
+}
+
+struct Result {
+    double offered;         // writes/s
+    double achieved;        // writes/s handled by onWrite()
+    uint32_t dropped;       // lost on the link or to a full BLE queue
+    double p50, p99, max;   // write -> handled, ms
+};
+
+struct Event {
+    bool notify;
+    uint64_t sentUs;
+};
+
+static Result run(const Options &options, double rate) {
+    std::vector<EmulatedLink *> links;
+    for (uint32_t c = 0; c < options.clients; c++) {
+        LinkConfig config = options.link;
+        config.seed = options.link.seed + c * 31;
+        links.push_back(new EmulatedLink(config));
+    }
+
+    // UART time per logged write; the FIFO hides nothing once it is full
+    uint64_t writeCostUs = options.serviceUs + (uint64_t)options.logBytes * 10 * 1000000 / options.baud;
+    uint64_t notifyCostUs = options.serviceUs;
+    uint64_t writeEveryUs = 1000000 / rate;
+    uint64_t notifyEveryUs = options.notifyRate > 0 ? 1000000 / options.notifyRate : 0;
+    uint64_t endUs = (uint64_t)options.seconds * 1000000;
+
+    std::deque<Event> queue;
+    uint64_t busyUntilUs = 0;
+    uint32_t sent = 0, handled = 0;
+    std::vector<double> latencyMs;
+    std::vector<uint64_t> nextWriteUs(options.clients);
+    for (uint32_t c = 0; c < options.clients; c++)
+        nextWriteUs[c] = c * writeEveryUs / options.clients;
+    uint64_t nextNotifyUs = 0;
+
+    // 50 us steps; the drain phase after endUs lets in-flight writes finish
+    for (uint64_t nowUs = 0; nowUs < endUs + 1000000; nowUs += 50) {
+        for (uint32_t c = 0; c < options.clients && nowUs < endUs; c++) {
+            if (nowUs < nextWriteUs[c])
+                continue;
+            nextWriteUs[c] += writeEveryUs;
+            links[c]->toServer.send(&nowUs, sizeof(nowUs), nowUs);
+            sent++;
+        }
+        if (notifyEveryUs > 0 && nowUs >= nextNotifyUs && nowUs < endUs) {
+            nextNotifyUs += notifyEveryUs;
+            if (queue.size() < options.queueDepth)
+                queue.push_back({ true, nowUs });
+        }
+        for (EmulatedLink *link : links) {
+            LinkPacket packet;
+            while (link->toServer.receive(nowUs, packet)) {
+                if (queue.size() < options.queueDepth)
+                    queue.push_back({ false, packet.sentUs });
+            }
+        }
+        while (!queue.empty() && busyUntilUs <= nowUs) {
+            Event event = queue.front();
+            queue.pop_front();
+            busyUntilUs = std::max(busyUntilUs, nowUs) + (event.notify ? notifyCostUs : writeCostUs);
+            if (!event.notify) {
+                handled++;
+                latencyMs.push_back((busyUntilUs - event.sentUs) / 1000.0);
+            }
+        }
+    }
+
+    for (EmulatedLink *link : links)
+        delete link;
+    Result result;
+    result.offered = sent / (double)options.seconds;
+    result.achieved = handled / (double)options.seconds;
+    result.dropped = sent - handled;
+    std::sort(latencyMs.begin(), latencyMs.end());
+    auto pct = [&](double p) { return latencyMs.empty() ? 0 : latencyMs[(size_t)(p * (latencyMs.size() - 1))]; };
+    result.p50 = pct(0.5);
+    result.p99 = pct(0.99);
+    result.max = latencyMs.empty() ? 0 : latencyMs.back();
+    return result;
+}
+
+static void printResult(const Result &result) {
+    printf("%10.1f %10.1f %8u %9.2f %9.2f %9.2f\n", result.offered, result.achieved, result.dropped, result.p50,
+        result.p99, result.max);
+}
+
+int main(int argc, char **argv) {
+    Options options = parseOptions(argc, argv);
+    printf("MODELLED, not measured: %u client(s), write cost %u us + %u log bytes at %u baud, %u notifies/s, "
+        "queue %u\n", options.clients, options.serviceUs, options.logBytes, options.baud, options.notifyRate,
+        options.queueDepth);
+    if (!options.costsGiven)
+        printf("write cost is the built-in estimate; pass --service-us and --log-bytes from the device, and "
+            "check the knee against the firmware loadgen\n");
+    printf("%10s %10s %8s %9s %9s %9s\n", "offered/s", "handled/s", "dropped", "p50 ms", "p99 ms", "max ms");
+
+    if (!options.sweep) {
+        printResult(run(options, options.rate));
+        return 0;
+    }
+
+    // Double the per-client rate until the tail latency falls apart
+    double baselineP99 = 0;
+    for (double rate = options.rate; rate <= 4000; rate *= 2) {
+        Result result = run(options, rate);
+        printResult(result);
+        if (baselineP99 == 0)
+            baselineP99 = result.p99;
+        if (result.dropped > 0 || result.p99 > 4 * baselineP99 + 5) {
+            printf("saturated at ~%.0f writes/s\n", result.achieved);
+            break;
+        }
+    }
+    return 0;
+}
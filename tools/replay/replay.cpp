@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////
+// Host replay tool for match recordings (lib/MatchRecorder)
+//
+//   pio run -e replay
+//   .pio/build/replay/program server003.rec [more.rec ...]
+//
+// Maps the file, walks every record and replays it through
+// lib/GameCore: positions go through dotsCollide() (what
+// checkDistance() decides), and the input pairs of an
+// authoritative server recording are re-simulated with
+// gameStep(). Prints latency/jitter statistics for the link.
+///////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <game_core.h>
+#include <match_record.h>
+
+// Screen enum value of the sketches' game over screen
+#define SCREEN_GAME_OVER 1
+
+///////////////////////////////////////////////////////////////
+// Intervals in microseconds, summarised as percentiles plus
+// jitter (mean change between consecutive intervals, RFC 3550)
+///////////////////////////////////////////////////////////////
+struct Intervals {
+    std::vector<double> samples;
+
+    void add(double us) { samples.push_back(us); }
+
+    void print(const char *name) {
+        if (samples.empty()) {
+            printf("  %-24s no samples\n", name);
+            return;
+        }
+        double jitter = 0;
+        for (size_t i = 1; i < samples.size(); i++)
+            jitter += fabs(samples[i] - samples[i - 1]);
+        jitter = samples.size() > 1 ? jitter / (samples.size() - 1) : 0;
+
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double s : sorted)
+            sum += s;
+        auto pct = [&](double p) { return sorted[(size_t)(p * (sorted.size() - 1))] / 1000.0; };
+        printf("  %-24s n=%-6zu mean=%7.2f p50=%7.2f p99=%7.2f max=%7.2f jitter=%6.2f ms\n", name,
+            sorted.size(), sum / sorted.size() / 1000.0, pct(0.5), pct(0.99), sorted.back() / 1000.0,
+            jitter / 1000.0);
+    }
+};
+
+struct Replay {
+    uint64_t clockUs = 0;       // unwrapped record time
+    uint32_t lastTimeUs = 0;
+    bool started = false;
+
+    size_t counts[256] = {};
+    std::map<uint16_t, uint64_t> lastRx;
+    std::map<uint16_t, Intervals> rxGaps;
+    Intervals positionGaps;
+    uint64_t lastPositionUs = 0;
+    bool havePosition = false;
+
+    // Collision decision: first colliding position -> game over record
+    bool colliding = false;
+    uint64_t collisionUs = 0;
+    Intervals collisionToGameOver;
+
+    // Re-simulation of authoritative ticks (remote sample, then local sample)
+    GameState state;
+    bool resimulate = false;
+    bool simulating = false;
+    bool haveRemote = false;
+    uint8_t remoteInput = 0;
+    size_t ticks = 0;
+    size_t checked = 0;
+    size_t mismatches = 0;
+
+    uint64_t advance(uint32_t timeUs) {
+        if (!started) {
+            started = true;
+            lastTimeUs = timeUs;
+        }
+        // Records from the BLE task and loop() can land a few microseconds out
+        // of order; time never runs backwards here
+        int32_t deltaUs = (int32_t)(timeUs - lastTimeUs);
+        if (deltaUs > 0) {
+            clockUs += deltaUs;
+            lastTimeUs = timeUs;
+        }
+        return clockUs;
+    }
+
+    void onMatch(uint64_t now, const RecordMatch &match) {
+        if (match.screen == SCREEN_GAME_OVER) {
+            if (colliding)
+                collisionToGameOver.add(now - collisionUs);
+        } else {
+            gameReset(state, match.sessionId);
+            simulating = resimulate;
+            haveRemote = false;
+        }
+        colliding = false;
+    }
+
+    void onPosition(uint64_t now, const RecordPosition &position) {
+        if (havePosition)
+            positionGaps.add(now - lastPositionUs);
+        havePosition = true;
+        lastPositionUs = now;
+
+        bool collide = dotsCollide(position.xServer, position.yServer, position.xClient, position.yClient);
+        if (collide && !colliding)
+            collisionUs = now;
+        colliding = collide;
+
+        if (simulating && ticks > 0) {
+            checked++;
+            if (state.server.x != position.xServer || state.server.y != position.yServer ||
+                state.client.x != position.xClient || state.client.y != position.yClient)
+                mismatches++;
+        }
+    }
+
+    void onInput(const RecordInput &input) {
+        if (input.side == SIDE_REMOTE) {
+            haveRemote = true;
+            remoteInput = input.input;
+        } else if (haveRemote && simulating) {
+            gameStep(state, input.input, remoteInput);
+            haveRemote = false;
+            ticks++;
+        }
+    }
+
+    void onBle(uint64_t now, const RecordBle &ble) {
+        if (ble.event != BLE_RX)
+            return;
+        auto last = lastRx.find(ble.handle);
+        if (last != lastRx.end())
+            rxGaps[ble.handle].add(now - last->second);
+        lastRx[ble.handle] = now;
+    }
+};
+
+static int replayFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    size_t size = info.st_size;
+    if (size < sizeof(RecordFileHeader)) {
+        fprintf(stderr, "%s: too short\n", path);
+        close(fd);
+        return 1;
+    }
+    const uint8_t *data = (const uint8_t *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+
+    RecordFileHeader header;
+    memcpy(&header, data, sizeof(header));
+    bool knownVersion = header.version == RECORD_VERSION || header.version == RECORD_VERSION_NO_MODE;
+    if (header.magic != RECORD_MAGIC || !knownVersion) {
+        fprintf(stderr, "%s: not a version %d (or %d) match recording\n", path, RECORD_VERSION,
+            RECORD_VERSION_NO_MODE);
+        munmap((void *)data, size);
+        return 1;
+    }
+    // The mode byte was reserved (zero) in version 1; don't take it for MODE_POSITIONS
+    bool modeKnown = header.version != RECORD_VERSION_NO_MODE;
+
+    auto wallStart = std::chrono::steady_clock::now();
+    Replay replay;
+    replay.resimulate = modeKnown && header.role == ROLE_SERVER && header.mode == MODE_AUTHORITATIVE;
+    size_t offset = sizeof(header);
+    size_t records = 0;
+    while (offset + sizeof(RecordHeader) <= size) {
+        RecordHeader record;
+        memcpy(&record, data + offset, sizeof(record));
+        const uint8_t *payload = data + offset + sizeof(record);
+        if (offset + sizeof(record) + record.length > size)
+            break;      // cut off mid-record (device reset before the flush)
+        offset += sizeof(record) + record.length;
+        records++;
+
+        uint64_t now = replay.advance(record.timeUs);
+        replay.counts[record.type]++;
+        switch (record.type) {
+            case REC_INPUT: {
+                RecordInput input;
+                if (record.length != sizeof(input)) break;
+                memcpy(&input, payload, sizeof(input));
+                replay.onInput(input);
+                break;
+            }
+            case REC_POSITION: {
+                RecordPosition position;
+                if (record.length != sizeof(position)) break;
+                memcpy(&position, payload, sizeof(position));
+                replay.onPosition(now, position);
+                break;
+            }
+            case REC_BLE: {
+                RecordBle ble;
+                if (record.length != sizeof(ble)) break;
+                memcpy(&ble, payload, sizeof(ble));
+                replay.onBle(now, ble);
+                break;
+            }
+            case REC_MATCH: {
+                RecordMatch match;
+                if (record.length != sizeof(match)) break;
+                memcpy(&match, payload, sizeof(match));
+                replay.onMatch(now, match);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    munmap((void *)data, size);
+
+    static const char *modes[] = { "positions", "lockstep", "authoritative" };
+    printf("%s: %s (%s), %zu records over %.1f s (replayed in %.2f ms)\n", path,
+        header.role == ROLE_SERVER ? "server" : "client", !modeKnown ? "mode not recorded" : header.mode <= MODE_AUTHORITATIVE ? modes[header.mode] : "?", records, replay.clockUs / 1e6, wallMs);
+    if (offset != size)
+        printf("  %zu trailing bytes ignored\n", size - offset);
+    printf("  inputs=%zu positions=%zu ble=%zu match=%zu\n", replay.counts[REC_INPUT],
+        replay.counts[REC_POSITION], replay.counts[REC_BLE], replay.counts[REC_MATCH]);
+
+    for (auto &gaps : replay.rxGaps) {
+        char name[32];
+        snprintf(name, sizeof(name), "rx handle %u", gaps.first);
+        gaps.second.print(name);
+    }
+    replay.positionGaps.print("position updates");
+    replay.collisionToGameOver.print("collision to game over");
+    if (replay.ticks > 0)
+        printf("  re-simulated %zu ticks, %zu/%zu positions differ\n", replay.ticks, replay.mismatches,
+            replay.checked);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording.rec [...]\n", argv[0]);
+        return 2;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+        status |= replayFile(argv[i]);
+    return status;
+}
@@ -0,0 +1,344 @@
+///////////////////////////////////////////////////////////////
+// Host decoder for the sketches' telemetry stream (TELEMETRY,
+// lib/Telemetry)
+//
+//   pio run -e telemetry
+//   .pio/build/telemetry/program /dev/ttyACM0 [--baud 115200]
+//   .pio/build/telemetry/program /dev/ttyACM0 --csv run1
+//   .pio/build/telemetry/program capture.bin --csv run1
+//
+// Without --csv, a live dashboard: frame rate, frame time
+// percentiles and stage timings over the last half second,
+// then RTT and memory from the latest stats, stream health and
+// the last log lines the sketch printed. With --csv, every
+// record goes to <prefix>-frames.csv / <prefix>-stats.csv and
+// log lines to stderr. A serial port is set to raw mode at
+// --baud; anything else (a capture made with cat) is read to
+// its end.
+///////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <match_record.h>
+#include <telemetry_stream.h>
+
+#define DASHBOARD_REFRESH_MS 500
+#define DASHBOARD_LOG_LINES 6
+
+struct Options {
+    const char *path = nullptr;
+    uint32_t baud = 115200;
+    const char *csvPrefix = nullptr;
+};
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s port-or-capture [--baud n] [--csv prefix]\n", name);
+    exit(2);
+}
+
+static Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const char *flag = argv[i];
+        if (flag[0] != '-') {
+            options.path = flag;
+            continue;
+        }
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        if (!strcmp(flag, "--baud")) options.baud = atoi(argv[++i]);
+        else if (!strcmp(flag, "--csv")) options.csvPrefix = argv[++i];
+        else usage(argv[0]);
+    }
+    if (options.path == nullptr)
+        usage(argv[0]);
+    return options;
+}
+
+static speed_t baudConstant(uint32_t baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        default: return 0;
+    }
+}
+
+static int openInput(const Options &options) {
+    int fd = open(options.path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(options.path);
+        return -1;
+    }
+    if (!isatty(fd))
+        return fd;
+    speed_t speed = baudConstant(options.baud);
+    struct termios tty;
+    if (speed == 0 || tcgetattr(fd, &tty) != 0) {
+        fprintf(stderr, "%s: can't set %u baud\n", options.path, options.baud);
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tty);
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+static uint64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static const char *roleName(uint8_t role) {
+    return role == ROLE_SERVER ? "server" : role == ROLE_CLIENT ? "client" : "?";
+}
+
+static const char *modeName(uint8_t mode) {
+    return mode == MODE_POSITIONS ? "positions" : mode == MODE_LOCKSTEP ? "lockstep" :
+           mode == MODE_AUTHORITATIVE ? "authoritative" : "?";
+}
+
+struct Decoder {
+    Options options;
+    TelemetryDecoder decoder;
+    FILE *framesCsv = nullptr;
+    FILE *statsCsv = nullptr;
+
+    // Device micros(), unwrapped
+    uint64_t clockUs = 0;
+    uint32_t lastTimeUs = 0;
+    bool started = false;
+
+    TelemetryHello hello = {};
+    bool haveHello = false;
+    TelemetryStats stats = {};
+    bool haveStats = false;
+    std::vector<TelemetryFrame> window;     // frames since the last dashboard refresh
+    uint64_t windowStartUs = 0;
+    uint64_t frames = 0;
+
+    // Stream health: frames lost on the way (seq gaps) and chunks that were neither frames nor text
+    uint8_t lastSeq = 0;
+    bool haveSeq = false;
+    uint64_t lost = 0;
+    uint64_t corrupt = 0;
+    std::string partialLine;
+    std::deque<std::string> logLines;
+
+    uint64_t advance(uint32_t timeUs) {
+        if (!started) {
+            started = true;
+            lastTimeUs = timeUs;
+        }
+        clockUs += (uint32_t)(timeUs - lastTimeUs);
+        lastTimeUs = timeUs;
+        return clockUs;
+    }
+
+    bool openCsv() {
+        if (options.csvPrefix == nullptr)
+            return true;
+        std::string prefix = options.csvPrefix;
+        framesCsv = fopen((prefix + "-frames.csv").c_str(), "w");
+        statsCsv = fopen((prefix + "-stats.csv").c_str(), "w");
+        if (framesCsv == nullptr || statsCsv == nullptr) {
+            perror(options.csvPrefix);
+            return false;
+        }
+        fprintf(framesCsv, "time_us,frame_us,network_us,game_us,render_us,screen\n");
+        fprintf(statsCsv, "time_us,rtt_us,free_heap,min_free_heap,largest_block,stack_free,dropped\n");
+        return true;
+    }
+
+    void closeCsv() {
+        if (framesCsv != nullptr)
+            fclose(framesCsv);
+        if (statsCsv != nullptr)
+            fclose(statsCsv);
+    }
+
+    void feed(uint8_t byte) {
+        TelemetryDecoder::Result result = decoder.feed(byte);
+        if (result == TelemetryDecoder::FRAME)
+            onFrame();
+        else if (result == TelemetryDecoder::TEXT)
+            onText(decoder.chunk(), decoder.chunkLength());
+    }
+
+    void onFrame() {
+        if (haveSeq)
+            lost += (uint8_t)(decoder.seq() - lastSeq - 1);
+        lastSeq = decoder.seq();
+        haveSeq = true;
+
+        // Records only grow at the end; anything shorter is from a version we don't know
+        switch (decoder.type()) {
+            case TLM_HELLO:
+                if (decoder.length() >= sizeof(hello)) {
+                    memcpy(&hello, decoder.payload(), sizeof(hello));
+                    haveHello = true;
+                }
+                break;
+            case TLM_FRAME:
+                if (decoder.length() >= sizeof(TelemetryFrame)) {
+                    TelemetryFrame frame;
+                    memcpy(&frame, decoder.payload(), sizeof(frame));
+                    onFrameRecord(frame);
+                }
+                break;
+            case TLM_STATS:
+                if (decoder.length() >= sizeof(stats)) {
+                    memcpy(&stats, decoder.payload(), sizeof(stats));
+                    haveStats = true;
+                    uint64_t now = advance(stats.timeUs);
+                    if (statsCsv != nullptr)
+                        fprintf(statsCsv, "%llu,%u,%u,%u,%u,%u,%u\n", (unsigned long long)now, stats.rttUs,
+                            stats.freeHeap, stats.minFreeHeap, stats.largestBlock, stats.stackFree, stats.dropped);
+                }
+                break;
+        }
+    }
+
+    void onFrameRecord(const TelemetryFrame &frame) {
+        uint64_t now = advance(frame.timeUs);
+        frames++;
+        if (window.empty())
+            windowStartUs = now;
+        window.push_back(frame);
+        if (framesCsv != nullptr)
+            fprintf(framesCsv, "%llu,%u,%u,%u,%u,%u\n", (unsigned long long)now, frame.frameUs,
+                frame.networkUs, frame.gameUs, frame.renderUs, frame.screen);
+    }
+
+    // Printed text arrives in pieces between frames; whole lines go to the log
+    void onText(const uint8_t *chunk, size_t length) {
+        for (size_t i = 0; i < length; i++)
+            if ((chunk[i] < 0x20 || chunk[i] > 0x7E) && chunk[i] != '\r' && chunk[i] != '\n' && chunk[i] != '\t') {
+                corrupt++;
+                return;
+            }
+        for (size_t i = 0; i < length; i++) {
+            char c = chunk[i];
+            if (c == '\r')
+                continue;
+            if (c != '\n') {
+                partialLine += c;
+                continue;
+            }
+            if (options.csvPrefix != nullptr)
+                fprintf(stderr, "%s\n", partialLine.c_str());
+            logLines.push_back(partialLine);
+            if (logLines.size() > DASHBOARD_LOG_LINES)
+                logLines.pop_front();
+            partialLine.clear();
+        }
+    }
+
+    void drawDashboard() {
+        printf("\033[H\033[2J");
+        if (haveHello)
+            printf("%s, %s mode, telemetry v%u\n\n", roleName(hello.role), modeName(hello.mode), hello.version);
+        else
+            printf("waiting for the device...\n\n");
+
+        if (window.empty()) {
+            printf("frames        none (not in a match)\n");
+        } else {
+            double spanS = (clockUs - windowStartUs) / 1e6;
+            std::vector<uint16_t> frameTimes;
+            uint64_t network = 0, game = 0, render = 0;
+            uint16_t networkMax = 0, gameMax = 0, renderMax = 0;
+            for (const TelemetryFrame &frame : window) {
+                if (frame.frameUs != 0)
+                    frameTimes.push_back(frame.frameUs);
+                network += frame.networkUs;
+                game += frame.gameUs;
+                render += frame.renderUs;
+                networkMax = std::max(networkMax, frame.networkUs);
+                gameMax = std::max(gameMax, frame.gameUs);
+                renderMax = std::max(renderMax, frame.renderUs);
+            }
+            std::sort(frameTimes.begin(), frameTimes.end());
+            auto pct = [&](double p) {
+                return frameTimes.empty() ? 0.0 : frameTimes[(size_t)(p * (frameTimes.size() - 1))] / 1000.0;
+            };
+            size_t n = window.size();
+            printf("frames        %7.1f /s  (%llu total)\n", spanS > 0 ? (n - 1) / spanS : 0.0,
+                (unsigned long long)frames);
+            printf("frame time    p50 %6.2f  p99 %6.2f  max %6.2f ms\n", pct(0.5), pct(0.99),
+                frameTimes.empty() ? 0.0 : frameTimes.back() / 1000.0);
+            printf("  network     mean %6.2f  max %6.2f ms\n", network / 1000.0 / n, networkMax / 1000.0);
+            printf("  game        mean %6.2f  max %6.2f ms\n", game / 1000.0 / n, gameMax / 1000.0);
+            printf("    render    mean %6.2f  max %6.2f ms\n", render / 1000.0 / n, renderMax / 1000.0);
+        }
+        printf("\n");
+        if (haveStats) {
+            if (stats.rttUs != 0)
+                printf("rtt           %6.2f ms\n", stats.rttUs / 1000.0);
+            else
+                printf("rtt           not measured on this side\n");
+            printf("heap          %u free, %u lowest, %u largest block\n", stats.freeHeap, stats.minFreeHeap,
+                stats.largestBlock);
+            printf("loop stack    %u bytes never used\n", stats.stackFree);
+        }
+        printf("stream        %u not sent (port busy), %llu lost, %llu corrupt\n", haveStats ? stats.dropped : 0,
+            (unsigned long long)lost, (unsigned long long)corrupt);
+        printf("\n");
+        for (const std::string &line : logLines)
+            printf("| %s\n", line.c_str());
+        fflush(stdout);
+        window.clear();
+    }
+};
+
+int main(int argc, char **argv) {
+    Decoder decoder;
+    decoder.options = parseOptions(argc, argv);
+    int fd = openInput(decoder.options);
+    if (fd < 0 || !decoder.openCsv())
+        return 1;
+    bool dashboard = decoder.options.csvPrefix == nullptr;
+
+    uint64_t lastDraw = nowMs();
+    uint8_t buffer[4096];
+    while (true) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, DASHBOARD_REFRESH_MS / 5) > 0) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+                break;
+            for (ssize_t i = 0; i < n; i++)
+                decoder.feed(buffer[i]);
+        }
+        if (dashboard && nowMs() - lastDraw >= DASHBOARD_REFRESH_MS) {
+            lastDraw = nowMs();
+            decoder.drawDashboard();
+        }
+    }
+
+    // End of a capture: the whole of it, or what came since the last refresh
+    if (dashboard)
+        decoder.drawDashboard();
+    decoder.closeCsv();
+    close(fd);
+    return 0;
+}